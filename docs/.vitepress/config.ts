@@ -30,6 +30,7 @@ export default defineConfig({
 					{ text: "Board Object", link: "/pages/board-object" },
 					{ text: "Move", link: "/pages/move-object" },
 					{ text: "Movelist Object", link: "/pages/movelist-object" },
+					{ text: "MovePicker Object", link: "/pages/move-picker" },
 					{ text: "Intrinsic Functions", link: "/pages/intrinsic" },
 					{ text: "Attacks", link: "/pages/attacks" },
 					{ text: "Helper Functions", link: "/pages/helpers" },
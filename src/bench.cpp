@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#include "chess.hpp"
+#include "perf_counters.hpp"
+
+using namespace chess;
+
+// Positions the microbenchmarks iterate over, a mix of opening, middlegame,
+// endgame, promotion and Chess960 positions.
+static const std::vector<std::pair<std::string, bool>> CORPUS = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", false},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", false},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", false},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", false},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", false},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 1", false},
+    {"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1", false},
+    {"1rqbkrbn/1ppppp1p/1n6/p1N3p1/8/2P4P/PP1PPPP1/1RQBKRBN w FBfb - 0 9", true},
+    {"1rkr3b/1ppn3p/3pB1n1/6q1/R2P4/4N1P1/1P5P/2KRQ1B1 b Dbd - 0 14", true},
+};
+
+// Prevents the compiler from optimizing the benchmarked expression away.
+static volatile uint64_t sink;
+
+struct BenchResult {
+    std::string name;
+    uint64_t ops;
+    std::vector<double> samples;  // ns per operation of every sample
+    PerfCounters::Reading reading;
+};
+
+class MicroBench {
+   public:
+    int samples = 50;
+    // minimal duration of one sample
+    int sampleUs = 2000;
+
+    // Every sample calls fn repeatedly for about `sampleUs`, fn returns the number of
+    // operations it did.
+    void run(const std::string &name, const std::function<uint64_t()> &fn) {
+        // warmup and calibration
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto once = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+
+        const int iterations = int(std::max<int64_t>(1, int64_t(sampleUs) * 1000 / (once + 1)));
+        for (int i = 0; i < iterations; i++) fn();
+
+        BenchResult result{name, 0, {}, {}};
+
+        counters_.start();
+
+        for (int s = 0; s < samples; s++) {
+            uint64_t ops = 0;
+
+            const auto t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) ops += fn();
+            const auto t2 = std::chrono::steady_clock::now();
+
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+            result.samples.push_back(double(ns) / double(std::max<uint64_t>(ops, 1)));
+            result.ops += ops;
+        }
+
+        result.reading = counters_.stop();
+
+        std::sort(result.samples.begin(), result.samples.end());
+
+        std::cerr << std::left << std::setw(28) << name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << median(result) << " ns/op  "
+                  << PerfCounters::describe(result.reading, result.ops, "op") << std::endl;
+
+        results_.push_back(std::move(result));
+    }
+
+    bool countersAvailable() const { return counters_.available(); }
+
+    std::string json() const {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2);
+        ss << "{\n  \"samples\": " << samples << ",\n  \"sample_us\": " << sampleUs
+           << ",\n  \"slider_backend\": \"" << (movegen::USE_PEXT ? "pext" : "magic")
+           << "\",\n  \"sliders_all_backend\": \"" << movegen::attacks::SLIDERS_ALL_BACKEND
+           << "\",\n  \"benchmarks\": [\n";
+
+        for (std::size_t i = 0; i < results_.size(); i++) {
+            const auto &r = results_[i];
+            const double med = median(r);
+
+            ss << "    {\"name\": \"" << r.name << "\", \"ops\": " << r.ops
+               << ", \"ns_per_op\": {\"min\": " << r.samples.front() << ", \"median\": " << med
+               << ", \"p99\": " << percentile(r, 0.99) << "}, \"ops_per_sec\": "
+               << (med > 0 ? 1e9 / med : 0.0);
+
+            if (r.reading.valid[PerfCounters::CYCLES] &&
+                r.reading.valid[PerfCounters::INSTRUCTIONS]) {
+                ss << ", \"ipc\": " << r.reading.ipc();
+            }
+
+            for (int e = 0; e < PerfCounters::COUNT; e++) {
+                if (!r.reading.valid[e]) continue;
+                ss << ", \"" << COUNTER_KEYS[e] << "\": "
+                   << double(r.reading.values[e]) / double(std::max<uint64_t>(r.ops, 1));
+            }
+
+            ss << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+        }
+
+        ss << "  ]\n}\n";
+        return ss.str();
+    }
+
+   private:
+    static double percentile(const BenchResult &r, double p) {
+        const auto index = std::size_t(p * double(r.samples.size() - 1) + 0.5);
+        return r.samples[std::min(index, r.samples.size() - 1)];
+    }
+
+    static double median(const BenchResult &r) { return percentile(r, 0.5); }
+
+    static constexpr const char *COUNTER_KEYS[PerfCounters::COUNT] = {
+        "cycles_per_op",     "instructions_per_op", "branch_misses_per_op",
+        "l1d_misses_per_op", "llc_misses_per_op",   "dtlb_misses_per_op"};
+
+    PerfCounters counters_;
+    std::vector<BenchResult> results_;
+};
+
+int main(int argc, char const *argv[]) {
+    MicroBench bench;
+
+    if (!bench.countersAvailable()) {
+        std::cerr << "hardware counters unavailable, reporting timings only" << std::endl;
+    }
+    std::string out;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            bench.samples = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--sample-us") == 0 && i + 1 < argc) {
+            bench.sampleUs = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        }
+    }
+
+    std::vector<Board> boards;
+    std::vector<Movelist> moves(CORPUS.size());
+    std::vector<std::vector<std::string>> sans(CORPUS.size());
+
+    for (std::size_t i = 0; i < CORPUS.size(); i++) {
+        Board board;
+        board.set960(CORPUS[i].second);
+        board.setFen(CORPUS[i].first);
+
+        movegen::legalmoves(moves[i], board);
+        for (const auto move : moves[i]) sans[i].push_back(uci::moveToSan(board, move));
+
+        boards.push_back(board);
+    }
+
+    bench.run("Board::setFen", [&]() {
+        for (std::size_t i = 0; i < CORPUS.size(); i++) {
+            boards[i].setFen(CORPUS[i].first);
+            sink = boards[i].hash();
+        }
+        return CORPUS.size();
+    });
+
+    bench.run("Board::getFen", [&]() {
+        for (const auto &board : boards) sink = board.getFen().size();
+        return boards.size();
+    });
+
+    bench.run("Board::makeMove+unmakeMove", [&]() {
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto move : moves[i]) {
+                boards[i].makeMove(move);
+                boards[i].unmakeMove(move);
+            }
+            sink = boards[i].hash();
+            ops += moves[i].size();
+        }
+        return ops;
+    });
+
+    bench.run("movegen::legalmoves<ALL>", [&]() {
+        Movelist list;
+        for (const auto &board : boards) {
+            movegen::legalmoves<MoveGenType::ALL>(list, board);
+            sink = list.size();
+        }
+        return boards.size();
+    });
+
+    bench.run("movegen::legalmoves<ALL> visitor", [&]() {
+        for (const auto &board : boards) {
+            int count = 0;
+            movegen::legalmoves<MoveGenType::ALL>(board, [&](Move) { count++; });
+            sink = count;
+        }
+        return boards.size();
+    });
+
+    bench.run("movegen::legalmoves<PSEUDO_ALL>", [&]() {
+        Movelist list;
+        for (const auto &board : boards) {
+            movegen::legalmoves<MoveGenType::PSEUDO_ALL>(list, board);
+            sink = list.size();
+        }
+        return boards.size();
+    });
+
+    bench.run("Board::isLegalAfterPseudo", [&]() {
+        uint64_t legal = 0;
+        uint64_t ops = 0;
+        Movelist list;
+        for (const auto &board : boards) {
+            movegen::legalmoves<MoveGenType::PSEUDO_ALL>(list, board);
+            for (const auto move : list) legal += board.isLegalAfterPseudo(move);
+            ops += list.size();
+        }
+        sink = legal;
+        return ops;
+    });
+
+    bench.run("movegen::legalmoves<CAPTURE>", [&]() {
+        Movelist list;
+        for (const auto &board : boards) {
+            movegen::legalmoves<MoveGenType::CAPTURE>(list, board);
+            sink = list.size();
+        }
+        return boards.size();
+    });
+
+    bench.run("movegen::legalmoves<QUIET>", [&]() {
+        Movelist list;
+        for (const auto &board : boards) {
+            movegen::legalmoves<MoveGenType::QUIET>(list, board);
+            sink = list.size();
+        }
+        return boards.size();
+    });
+
+    bench.run("movegen::legalmoves<CHECKS>", [&]() {
+        Movelist list;
+        for (const auto &board : boards) {
+            movegen::legalmoves<MoveGenType::CHECKS>(list, board);
+            sink = list.size();
+        }
+        return boards.size();
+    });
+
+    bench.run("Board::isLegal", [&]() {
+        uint64_t legal = 0;
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            // the moves of the next position are mostly illegal here
+            for (const Movelist *list : {&moves[i], &moves[(i + 1) % boards.size()]}) {
+                for (const auto move : *list) legal += boards[i].isLegal(move);
+                ops += list->size();
+            }
+        }
+        sink = legal;
+        return ops;
+    });
+
+    bench.run("Board::givesCheck", [&]() {
+        uint64_t checks = 0;
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto move : moves[i]) checks += boards[i].givesCheck(move);
+            ops += moves[i].size();
+        }
+        sink = checks;
+        return ops;
+    });
+
+    bench.run("Board::keyAfter", [&]() {
+        uint64_t keys = 0;
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto move : moves[i]) keys ^= boards[i].keyAfter(move);
+            ops += moves[i].size();
+        }
+        sink = keys;
+        return ops;
+    });
+
+    bench.run("Board::see", [&]() {
+        uint64_t good = 0;
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto move : moves[i]) {
+                if (boards[i].at(move.to()) == Piece::NONE || move.typeOf() == Move::CASTLING)
+                    continue;
+                good += boards[i].see(move, 0);
+                ops++;
+            }
+        }
+        sink = good;
+        return ops;
+    });
+
+    // scores spread over a small range so that the sorts see ties
+    const auto orderScore = [](Move move) { return int16_t((move.move() * 2654435761u) >> 24); };
+
+    bench.run("Movelist::sort", [&]() {
+        uint64_t ops = 0;
+        for (const auto &list : moves) {
+            Movelist sorted = list;
+            for (auto &move : sorted) move.setScore(orderScore(move));
+            sorted.sort();
+            sink = sorted[0].move();
+            ops += sorted.size();
+        }
+        return ops;
+    });
+
+    bench.run("ScoredMovelist::sort", [&]() {
+        uint64_t ops = 0;
+        ScoredMovelist sorted;
+        for (const auto &list : moves) {
+            sorted.clear();
+            for (const auto move : list) sorted.add(move, orderScore(move));
+            sorted.sort();
+            sink = sorted.move(0).move();
+            ops += sorted.size();
+        }
+        return ops;
+    });
+
+    bench.run("ScoredMovelist::partialSort(4)", [&]() {
+        uint64_t ops = 0;
+        ScoredMovelist sorted;
+        for (const auto &list : moves) {
+            sorted.clear();
+            for (const auto move : list) sorted.add(move, orderScore(move));
+            sorted.partialSort(4);
+            sink = sorted.move(0).move();
+            ops += sorted.size();
+        }
+        return ops;
+    });
+
+    bench.run("MovePicker first move", [&]() {
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            MovePicker picker(boards[i], Move::NO_MOVE);
+            sink = picker.next().move();
+        }
+        return boards.size();
+    });
+
+    // positions reached by the checking moves of the corpus
+    std::vector<Board> evasions;
+    for (std::size_t i = 0; i < boards.size(); i++) {
+        for (const auto move : moves[i]) {
+            Board board = boards[i];
+            board.makeMove(move);
+            if (board.inCheck()) evasions.push_back(board);
+        }
+    }
+
+    bench.run("movegen::legalmoves<ALL> in check", [&]() {
+        Movelist list;
+        for (const auto &board : evasions) {
+            movegen::legalmoves<MoveGenType::ALL>(list, board);
+            sink = list.size();
+        }
+        return evasions.size();
+    });
+
+    bench.run("Board::isAttacked", [&]() {
+        uint64_t attacked = 0;
+        for (const auto &board : boards) {
+            for (Square sq = SQ_A1; sq <= SQ_H8; ++sq) {
+                attacked += board.isAttacked(sq, ~board.sideToMove());
+            }
+        }
+        sink = attacked;
+        return boards.size() * MAX_SQ;
+    });
+
+    bench.run("attacks::bishop+rook", [&]() {
+        uint64_t sum = 0;
+        for (const auto &board : boards) {
+            for (Square sq = SQ_A1; sq <= SQ_H8; ++sq) {
+                sum += movegen::attacks::bishop(sq, board.occ()) ^
+                       movegen::attacks::rook(sq, board.occ());
+            }
+        }
+        sink = sum;
+        return boards.size() * MAX_SQ;
+    });
+
+    bench.run("attacks::slidersAll", [&]() {
+        uint64_t sum = 0;
+        for (const auto &board : boards) {
+            for (Color c : {Color::WHITE, Color::BLACK}) {
+                const Bitboard queens = board.pieces(PieceType::QUEEN, c);
+                sum ^= movegen::attacks::slidersAll(
+                    board.pieces(PieceType::BISHOP, c) | queens,
+                    board.pieces(PieceType::ROOK, c) | queens, board.occ());
+            }
+        }
+        sink = sum;
+        return boards.size() * 2;
+    });
+
+    bench.run("Board::isGameOver", [&]() {
+        for (const auto &board : boards) sink = int(board.isGameOver().second);
+        return boards.size();
+    });
+
+    bench.run("Board::isGameOverReason", [&]() {
+        for (const auto &board : boards) sink = int(board.isGameOverReason().first);
+        return boards.size();
+    });
+
+    bench.run("movegen::hasLegalMove", [&]() {
+        for (const auto &board : boards) sink = movegen::hasLegalMove(board);
+        return boards.size();
+    });
+
+    bench.run("movegen::movesTo", [&]() {
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto move : moves[i]) {
+                sink = movegen::movesTo(boards[i], move.to(), boards[i].at<PieceType>(move.from()))
+                           .size();
+            }
+            ops += moves[i].size();
+        }
+        return ops;
+    });
+
+    bench.run("uci::moveToSan", [&]() {
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto move : moves[i]) sink = uci::moveToSan(boards[i], move).size();
+            ops += moves[i].size();
+        }
+        return ops;
+    });
+
+    bench.run("uci::parseSan", [&]() {
+        uint64_t ops = 0;
+        for (std::size_t i = 0; i < boards.size(); i++) {
+            for (const auto &san : sans[i]) sink = uci::parseSan(boards[i], san).move();
+            ops += sans[i].size();
+        }
+        return ops;
+    });
+
+    const auto json = bench.json();
+
+    if (out.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream file(out);
+        file << json;
+    }
+
+    return 0;
+}
@@ -37,8 +37,39 @@ Source: https://github.com/Disservin/chess-library
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#ifdef CHESS_STATS
+#include <mutex>
+#endif
+
+// Slider attacks use PEXT on BMI2 hardware, define CHESS_NO_PEXT to force the magic lookup.
+#if defined(__BMI2__) && !defined(CHESS_NO_PEXT)
+#define CHESS_USE_PEXT
+#endif
+
+// Attacks of whole slider sets use a Kogge-Stone fill on AVX2/AVX-512 hardware when the magic
+// lookup is in use (PEXT lookups are faster than the fill), define CHESS_NO_SIMD to force the
+// per piece lookups.
+#if !defined(CHESS_USE_PEXT) && !defined(CHESS_NO_SIMD)
+#if defined(__AVX512F__)
+#define CHESS_USE_AVX512
+#elif defined(__AVX2__)
+#define CHESS_USE_AVX2
+#endif
+#endif
+
+// ScoredMovelist sorts with an AVX2 network, CHESS_NO_SIMD falls back to std::sort.
+#if defined(__AVX2__) && !defined(CHESS_NO_SIMD)
+#define CHESS_USE_AVX2_SORT
+#endif
+
+#if defined(CHESS_USE_PEXT) || defined(CHESS_USE_AVX512) || defined(CHESS_USE_AVX2) || \
+    defined(CHESS_USE_AVX2_SORT)
+#include <immintrin.h>
+#endif
+
 namespace chess {
 
 /****************************************************************************\
@@ -52,7 +83,16 @@ using Bitboard = std::uint64_t;  // clear distinction between bitboard and U64
  * Enumerations                                                              *
 \****************************************************************************/
 
-enum class MoveGenType : uint8_t { ALL, CAPTURE, QUIET };
+/// CAPTURE includes promotions, CHECKS are the quiet moves which give check.
+enum class MoveGenType : uint8_t {
+    ALL,
+    CAPTURE,
+    QUIET,
+    CHECKS,
+    CAPTURES_AND_CHECKS,
+    PSEUDO_ALL,
+    PSEUDO_CAPTURE
+};
 
 // clang-format off
 enum Square : uint8_t {
@@ -140,6 +180,15 @@ constexpr GameResult operator~(GameResult gm) {
         return GameResult::NONE;
 }
 
+enum class GameResultReason {
+    CHECKMATE,
+    STALEMATE,
+    INSUFFICIENT_MATERIAL,
+    FIFTY_MOVE_RULE,
+    THREEFOLD_REPETITION,
+    NONE
+};
+
 /****************************************************************************\
  * Constants                                                                 *
 \****************************************************************************/
@@ -149,10 +198,13 @@ constexpr int MAX_PIECE = 12;
 constexpr int MAX_MOVES = 256;
 constexpr Bitboard DEFAULT_CHECKMASK = 18446744073709551615ULL;
 
-static const std::string STARTPOS = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+// piece values used by the static exchange evaluation and the move picker, indexed by PieceType
+inline constexpr int PIECE_VALUE[7] = {100, 320, 330, 500, 900, 0, 0};
+
+inline const std::string STARTPOS = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 // clang-format off
-const std::string squareToString[64] = {
+inline const std::string squareToString[64] = {
     "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1",
     "a2", "b2", "c2", "d2", "e2", "f2", "g2", "h2",
     "a3", "b3", "c3", "d3", "e3", "f3", "g3", "h3",
@@ -164,7 +216,7 @@ const std::string squareToString[64] = {
 };
 // clang-format on
 
-static std::unordered_map<char, Piece> charToPiece({{'P', Piece::WHITEPAWN},
+inline std::unordered_map<char, Piece> charToPiece({{'P', Piece::WHITEPAWN},
                                                     {'N', Piece::WHITEKNIGHT},
                                                     {'B', Piece::WHITEBISHOP},
                                                     {'R', Piece::WHITEROOK},
@@ -178,7 +230,7 @@ static std::unordered_map<char, Piece> charToPiece({{'P', Piece::WHITEPAWN},
                                                     {'k', Piece::BLACKKING},
                                                     {'.', Piece::NONE}});
 
-static std::unordered_map<Piece, char> pieceToChar({{Piece::WHITEPAWN, 'P'},
+inline std::unordered_map<Piece, char> pieceToChar({{Piece::WHITEPAWN, 'P'},
                                                     {Piece::WHITEKNIGHT, 'N'},
                                                     {Piece::WHITEBISHOP, 'B'},
                                                     {Piece::WHITEROOK, 'R'},
@@ -192,14 +244,14 @@ static std::unordered_map<Piece, char> pieceToChar({{Piece::WHITEPAWN, 'P'},
                                                     {Piece::BLACKKING, 'k'},
                                                     {Piece::NONE, '.'}});
 
-static std::unordered_map<PieceType, char> PieceTypeToChar({{PieceType::PAWN, 'p'},
+inline std::unordered_map<PieceType, char> PieceTypeToChar({{PieceType::PAWN, 'p'},
                                                             {PieceType::KNIGHT, 'n'},
                                                             {PieceType::BISHOP, 'b'},
                                                             {PieceType::ROOK, 'r'},
                                                             {PieceType::QUEEN, 'q'},
                                                             {PieceType::KING, 'k'}});
 
-static std::unordered_map<char, PieceType> charToPieceType({{'n', PieceType::KNIGHT},
+inline std::unordered_map<char, PieceType> charToPieceType({{'n', PieceType::KNIGHT},
                                                             {'b', PieceType::BISHOP},
                                                             {'r', PieceType::ROOK},
                                                             {'q', PieceType::QUEEN},
@@ -325,12 +377,27 @@ class CastlingRights {
     BitField16 castling_rights;
 };
 
+/// @brief Check and pin information for the side to move, computed once per move.
+struct CheckInfo {
+    // enemy pieces giving check
+    Bitboard checkers;
+    // pin rays to our king including the pinner, split by slider type
+    Bitboard pin_hv;
+    Bitboard pin_d;
+    // squares from which a pawn, knight, bishop or rook of the side to move would check the
+    // enemy king, queens use the bishop and rook squares
+    Bitboard check_squares[4];
+    // our pieces which uncover a check on the enemy king when they leave their ray
+    Bitboard discoverers;
+};
+
 struct State {
     U64 hash;
     CastlingRights castling;
     Square enpassant;
     uint8_t half_moves;
     Piece captured_piece;
+    CheckInfo check_info;
 };
 
 struct Move {
@@ -433,6 +500,163 @@ struct Movelist {
     int size_ = 0;
 };
 
+/*
+ Movelist for move ordering. Moves and scores live in separate arrays so that
+ searching for the best score and sorting work on packed lanes instead of
+ skipping over the interleaved move halves. Both pickBest and sort are stable,
+ moves with equal scores keep the order in which they were added.
+ */
+struct ScoredMovelist {
+   public:
+    constexpr void add(Move move, int16_t score = 0) {
+        assert(size_ < MAX_MOVES);
+        moves_[size_] = move.move();
+        scores_[size_++] = score;
+    }
+
+    constexpr int size() const { return size_; }
+
+    constexpr void clear() { size_ = 0; }
+
+    [[nodiscard]] constexpr Move move(int index) const { return Move(moves_[index]); }
+    [[nodiscard]] constexpr int16_t score(int index) const { return scores_[index]; }
+    constexpr void setScore(int index, int16_t score) { scores_[index] = score; }
+
+    /// @brief Index of the first highest score at or after index, -1 if there is none.
+    [[nodiscard]] int bestIndex(int index = 0) const;
+
+    /// @brief Moves the best remaining move to index and returns it with its score set.
+    Move pickBest(int index);
+
+    /// @brief Orders the n best moves at the front, the others keep their relative order.
+    /// For n > 8 the whole list is sorted instead.
+    void partialSort(int n);
+
+    /// @brief Sorts all moves by descending score.
+    void sort();
+
+   private:
+    static_assert((MAX_MOVES & (MAX_MOVES - 1)) == 0, "the sorting network needs a power of 2");
+
+    alignas(64) uint16_t moves_[MAX_MOVES];
+    alignas(64) int16_t scores_[MAX_MOVES];
+    int size_ = 0;
+};
+
+/****************************************************************************\
+ * Hot path statistics, only compiled in with -DCHESS_STATS                  *
+\****************************************************************************/
+
+#ifdef CHESS_STATS
+
+namespace stats {
+
+constexpr int MAX_REPETITION_SCAN = 128;
+
+struct Counters {
+    uint64_t make_move[4] = {};  // indexed by Move::typeOf() >> 14
+    uint64_t unmake_move = 0;
+
+    uint64_t legalmoves = 0;
+    uint64_t movelist_size[MAX_MOVES + 1] = {};
+    uint64_t checks[3] = {};  // no check, single check, double check
+
+    uint64_t enpassant_attempts = 0;
+    uint64_t enpassant_moves = 0;
+
+    uint64_t repetition_calls = 0;
+    uint64_t repetition_scan[MAX_REPETITION_SCAN + 1] = {};  // number of states compared
+
+    void add(const Counters &other) {
+        for (int i = 0; i < 4; i++) make_move[i] += other.make_move[i];
+        unmake_move += other.unmake_move;
+        legalmoves += other.legalmoves;
+        for (int i = 0; i <= MAX_MOVES; i++) movelist_size[i] += other.movelist_size[i];
+        for (int i = 0; i < 3; i++) checks[i] += other.checks[i];
+        enpassant_attempts += other.enpassant_attempts;
+        enpassant_moves += other.enpassant_moves;
+        repetition_calls += other.repetition_calls;
+        for (int i = 0; i <= MAX_REPETITION_SCAN; i++)
+            repetition_scan[i] += other.repetition_scan[i];
+    }
+};
+
+/// @brief Counters of the calling thread
+inline Counters &local() {
+    static thread_local Counters counters;
+    return counters;
+}
+
+inline std::mutex &totalMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline Counters &totalCounters() {
+    static Counters counters;
+    return counters;
+}
+
+/// @brief Adds the counters of the calling thread to the process wide total and resets them.
+/// Worker threads should call this before they exit.
+inline void flush() {
+    std::lock_guard<std::mutex> lock(totalMutex());
+    totalCounters().add(local());
+    local() = Counters{};
+}
+
+/// @brief Flushes the calling thread and returns the process wide total
+inline Counters total() {
+    flush();
+    std::lock_guard<std::mutex> lock(totalMutex());
+    return totalCounters();
+}
+
+inline void reset() {
+    std::lock_guard<std::mutex> lock(totalMutex());
+    totalCounters() = Counters{};
+    local() = Counters{};
+}
+
+inline void print(std::ostream &os, const Counters &c) {
+    static const char *moveTypes[4] = {"normal", "promotion", "enpassant", "castling"};
+
+    uint64_t moves = 0;
+    for (int i = 0; i < 4; i++) moves += c.make_move[i];
+
+    os << "makeMove " << moves << " unmakeMove " << c.unmake_move << "\n";
+    for (int i = 0; i < 4; i++) {
+        os << "  " << moveTypes[i] << " " << c.make_move[i] << " ("
+           << (moves ? 100.0 * c.make_move[i] / moves : 0.0) << "%)\n";
+    }
+
+    os << "legalmoves " << c.legalmoves << "\n";
+    os << "  no check " << c.checks[0] << " single check " << c.checks[1] << " double check "
+       << c.checks[2] << "\n";
+    os << "  en passant attempts " << c.enpassant_attempts << " moves " << c.enpassant_moves
+       << "\n";
+    os << "  movelist size histogram (size: count)\n";
+    for (int i = 0; i <= MAX_MOVES; i++) {
+        if (c.movelist_size[i]) os << "    " << i << ": " << c.movelist_size[i] << "\n";
+    }
+
+    os << "isRepetition " << c.repetition_calls << "\n";
+    os << "  scan length histogram (states: count)\n";
+    for (int i = 0; i <= MAX_REPETITION_SCAN; i++) {
+        if (c.repetition_scan[i]) os << "    " << i << ": " << c.repetition_scan[i] << "\n";
+    }
+}
+
+}  // namespace stats
+
+#define CHESS_STAT(expr) (expr)
+
+#else
+
+#define CHESS_STAT(expr) ((void)0)
+
+#endif
+
 /****************************************************************************\
  * Various utility functions used across the codebase                        *
 \****************************************************************************/
@@ -623,11 +847,167 @@ inline Square poplsb(Bitboard &mask) {
 
 }  // namespace builtin
 
+inline int ScoredMovelist::bestIndex(int index) const {
+    if (index >= size_) return -1;
+
+#ifdef CHESS_USE_AVX2_SORT
+    // blocks of 16 scores, lanes outside [index, size_) are masked out
+    const __m256i iota = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m256i lower = _mm256_set1_epi16(int16_t(index - 1));
+    const __m256i upper = _mm256_set1_epi16(int16_t(size_));
+    const int first = index & ~15;
+
+    const auto valid = [&](int i) {
+        const __m256i lane = _mm256_add_epi16(_mm256_set1_epi16(int16_t(i)), iota);
+        return _mm256_and_si256(_mm256_cmpgt_epi16(lane, lower), _mm256_cmpgt_epi16(upper, lane));
+    };
+
+    __m256i best = _mm256_set1_epi16(INT16_MIN);
+
+    for (int i = first; i < size_; i += 16) {
+        const __m256i scores = _mm256_load_si256(reinterpret_cast<const __m256i *>(scores_ + i));
+        best = _mm256_max_epi16(best, _mm256_blendv_epi8(best, scores, valid(i)));
+    }
+
+    // horizontal max, minpos on the flipped values finds the largest signed score
+    __m128i max = _mm_max_epi16(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    max = _mm_minpos_epu16(_mm_xor_si128(max, _mm_set1_epi16(0x7FFF)));
+    best = _mm256_set1_epi16(int16_t(_mm_extract_epi16(max, 0) ^ 0x7FFF));
+
+    for (int i = first; i < size_; i += 16) {
+        const __m256i scores = _mm256_load_si256(reinterpret_cast<const __m256i *>(scores_ + i));
+        const int mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi16(scores, best), valid(i)));
+
+        if (mask) return i + builtin::lsb(uint32_t(mask)) / 2;
+    }
+
+    assert(false);
+    return -1;
+#else
+    int best = index;
+
+    for (int i = index + 1; i < size_; i++) {
+        if (scores_[i] > scores_[best]) best = i;
+    }
+
+    return best;
+#endif
+}
+
+inline Move ScoredMovelist::pickBest(int index) {
+    assert(index < size_);
+
+    const int best = bestIndex(index);
+    const uint16_t move = moves_[best];
+    const int16_t score = scores_[best];
+
+    // shift instead of swap so that the remaining moves stay in order
+    std::copy_backward(moves_ + index, moves_ + best, moves_ + best + 1);
+    std::copy_backward(scores_ + index, scores_ + best, scores_ + best + 1);
+    moves_[index] = move;
+    scores_[index] = score;
+
+    Move picked(move);
+    picked.setScore(score);
+    return picked;
+}
+
+inline void ScoredMovelist::partialSort(int n) {
+    n = std::min(n, size_);
+
+    // selection is quadratic, past a few moves the full sort is cheaper
+    if (n > 8) return sort();
+
+    for (int i = 0; i < n; i++) pickBest(i);
+}
+
+inline void ScoredMovelist::sort() {
+    if (size_ < 2) return;
+
+    /*
+     Sort 32 bit keys made of the score and the inverted index. The keys are
+     unique, so any sort of them is stable, and the move is found again through
+     the index afterwards.
+     */
+    alignas(64) int32_t keys[MAX_MOVES];
+
+#ifdef CHESS_USE_AVX2_SORT
+    int n = 8;
+    while (n < size_) n <<= 1;
+
+    const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i size = _mm256_set1_epi32(size_);
+
+    for (int i = 0; i < n; i += 8) {
+        const __m256i index = _mm256_add_epi32(_mm256_set1_epi32(i), iota);
+        const __m256i scores =
+            _mm256_cvtepi16_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(scores_ + i)));
+        const __m256i key = _mm256_or_si256(_mm256_slli_epi32(scores, 16),
+                                            _mm256_sub_epi32(_mm256_set1_epi32(0xFFFF), index));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(keys + i),
+                           _mm256_blendv_epi8(_mm256_set1_epi32(INT32_MIN), key,
+                                              _mm256_cmpgt_epi32(size, index)));
+    }
+
+    // bitonic network, blocks whose index has the k bit clear are sorted descending
+    for (int k = 2; k <= n; k <<= 1) {
+        for (int j = k >> 1; j >= 8; j >>= 1) {
+            for (int i = 0; i < n; i += 8) {
+                if (i & j) continue;
+
+                const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+                const __m256i b =
+                    _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i + j));
+                const __m256i lo = (i & k) ? _mm256_min_epi32(a, b) : _mm256_max_epi32(a, b);
+                const __m256i hi = (i & k) ? _mm256_max_epi32(a, b) : _mm256_min_epi32(a, b);
+
+                _mm256_store_si256(reinterpret_cast<__m256i *>(keys + i), lo);
+                _mm256_store_si256(reinterpret_cast<__m256i *>(keys + i + j), hi);
+            }
+        }
+
+        // distances below 8 compare lanes of the same register
+        for (int j = std::min(k >> 1, 4); j > 0; j >>= 1) {
+            const __m256i partner = _mm256_xor_si256(iota, _mm256_set1_epi32(j));
+
+            for (int i = 0; i < n; i += 8) {
+                const __m256i lane = _mm256_add_epi32(_mm256_set1_epi32(i), iota);
+                const __m256i descending = _mm256_cmpeq_epi32(
+                    _mm256_and_si256(lane, _mm256_set1_epi32(k)), _mm256_setzero_si256());
+                const __m256i second = _mm256_cmpeq_epi32(
+                    _mm256_and_si256(lane, _mm256_set1_epi32(j)), _mm256_set1_epi32(j));
+
+                const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+                const __m256i b = _mm256_permutevar8x32_epi32(a, partner);
+
+                _mm256_store_si256(
+                    reinterpret_cast<__m256i *>(keys + i),
+                    _mm256_blendv_epi8(_mm256_min_epi32(a, b), _mm256_max_epi32(a, b),
+                                       _mm256_xor_si256(descending, second)));
+            }
+        }
+    }
+#else
+    for (int i = 0; i < size_; i++) keys[i] = int32_t(scores_[i]) * 65536 + (0xFFFF - i);
+
+    std::sort(keys, keys + size_, std::greater<int32_t>());
+#endif
+
+    uint16_t moves[MAX_MOVES];
+    std::copy(moves_, moves_ + size_, moves);
+
+    for (int i = 0; i < size_; i++) {
+        moves_[i] = moves[0xFFFF - (keys[i] & 0xFFFF)];
+        scores_[i] = int16_t(keys[i] >> 16);
+    }
+}
+
 /****************************************************************************\
  * Polyglot Zobrist Hash                                                     *
 \****************************************************************************/
 namespace zobrist {
-static constexpr U64 RANDOM_ARRAY[781] = {
+inline constexpr U64 RANDOM_ARRAY[781] = {
     0x9D39247E33776D41, 0x2AF7398005AAA5C7, 0x44DB015024623547, 0x9C15F73E62A76AE2,
     0x75834465489C0C89, 0x3290AC3A203001BF, 0x0FBBAD1F61042279, 0xE83A908FF2FB60CA,
     0x0D7E765D58755C10, 0x1A083822CEAFE02D, 0x9605D5F0E25EC3B0, 0xD021FF5CD13A2ED5,
@@ -825,7 +1205,7 @@ static constexpr U64 RANDOM_ARRAY[781] = {
     0xCF3145DE0ADD4289, 0xD0E4427A5514FB72, 0x77C621CC9FB3A483, 0x67A34DAC4356550B,
     0xF8D626AAAF278509};
 
-static constexpr U64 castlingKey[16] = {
+inline constexpr U64 castlingKey[16] = {
     0,
     RANDOM_ARRAY[768],
     RANDOM_ARRAY[768 + 1],
@@ -843,7 +1223,7 @@ static constexpr U64 castlingKey[16] = {
     RANDOM_ARRAY[768 + 1] ^ RANDOM_ARRAY[768 + 2] ^ RANDOM_ARRAY[768 + 3],
     RANDOM_ARRAY[768 + 1] ^ RANDOM_ARRAY[768 + 2] ^ RANDOM_ARRAY[768 + 3] ^ RANDOM_ARRAY[768]};
 
-static constexpr int MAP_HASH_PIECE[12] = {1, 3, 5, 7, 9, 11, 0, 2, 4, 6, 8, 10};
+inline constexpr int MAP_HASH_PIECE[12] = {1, 3, 5, 7, 9, 11, 0, 2, 4, 6, 8, 10};
 
 inline U64 piece(Piece piece, Square square) {
     return RANDOM_ARRAY[64 * MAP_HASH_PIECE[static_cast<int>(piece)] + square];
@@ -875,6 +1255,11 @@ Bitboard king(Square sq);
 template <MoveGenType mt = MoveGenType::ALL>
 void legalmoves(Movelist &movelist, const Board &board);
 
+template <Color c>
+CheckInfo checkInfo(const Board &board);
+
+[[nodiscard]] inline bool hasLegalMove(const Board &board);
+
 }  // namespace movegen
 
 /****************************************************************************\
@@ -890,6 +1275,10 @@ class Board {
     void makeMove(const Move &move);
     void unmakeMove(const Move &move);
 
+    /// @brief makeMove for a variant known at compile time, skips the chess960() check.
+    template <bool chess960>
+    void makeMove(const Move &move);
+
     void makeNullMove();
     void unmakeNullMove();
 
@@ -957,10 +1346,63 @@ class Board {
 
     [[nodiscard]] std::pair<std::string, GameResult> isGameOver() const;
 
+    /// @brief Like isGameOver, but reports the reason as an enum and doesn't allocate.
+    [[nodiscard]] std::pair<GameResultReason, GameResult> isGameOverReason() const;
+
     [[nodiscard]] bool isAttacked(Square square, Color color) const;
 
+    /// @brief Pieces of both colors attacking the square, sliders see through the given occupancy.
+    [[nodiscard]] Bitboard attackersTo(Square square, Bitboard occupied) const;
+
+    /// @brief Whether the static exchange on the target square gains at least threshold,
+    /// pins are not taken into account. Promotions, en passant and castling count as 0.
+    [[nodiscard]] bool see(const Move &move, int threshold) const;
+
     [[nodiscard]] bool inCheck() const;
 
+    /// @brief Whether the move fits the piece on its from square and the occupancy, it may
+    /// still leave the own king in check. Castling also needs the rights and an empty path.
+    [[nodiscard]] bool isPseudoLegal(const Move &move) const;
+
+    /// @brief Whether legalmoves would generate the move, any move value is accepted.
+    [[nodiscard]] bool isLegal(const Move &move) const;
+
+    /// @brief Whether a move from the PSEUDO_ALL or PSEUDO_CAPTURE generation is legal, only
+    /// looks at pins, king moves, en passant and castling.
+    [[nodiscard]] bool isLegalAfterPseudo(const Move &move) const;
+
+    /// @brief Whether a legal move gives check, without making it.
+    [[nodiscard]] bool givesCheck(const Move &move) const;
+
+    /// @brief The hash the position would have after a legal move, e.g. to prefetch a
+    /// transposition table entry before makeMove.
+    [[nodiscard]] U64 keyAfter(const Move &move) const;
+
+    /// @brief Enemy pieces giving check to the side to move.
+    [[nodiscard]] Bitboard checkers() const { return check_info_.checkers; }
+
+    /// @brief Pieces of the side to move which are pinned to their king.
+    [[nodiscard]] Bitboard pinned() const {
+        return (check_info_.pin_hv | check_info_.pin_d) & us(side_to_move_);
+    }
+
+    /// @brief Horizontal and vertical pin rays to the king of the side to move.
+    [[nodiscard]] Bitboard pinHV() const { return check_info_.pin_hv; }
+
+    /// @brief Diagonal pin rays to the king of the side to move.
+    [[nodiscard]] Bitboard pinD() const { return check_info_.pin_d; }
+
+    /// @brief Pieces of the side to move which give a discovered check by leaving their ray.
+    [[nodiscard]] Bitboard discoverers() const { return check_info_.discoverers; }
+
+    /// @brief Squares from which a piece of the side to move would give check.
+    [[nodiscard]] Bitboard checkSquares(PieceType pt) const {
+        if (pt == PieceType::QUEEN)
+            return checkSquares(PieceType::BISHOP) | checkSquares(PieceType::ROOK);
+        if (pt == PieceType::KING) return 0ULL;
+        return check_info_.check_squares[static_cast<int>(pt)];
+    }
+
     [[nodiscard]] U64 zobrist() const;
 
     friend std::ostream &operator<<(std::ostream &os, const Board &board);
@@ -971,8 +1413,16 @@ class Board {
 
     [[nodiscard]] Piece removePiece(Square sq);
 
+    void updateCheckInfo();
+
+    /// @brief The castling rights left after the move, shared by makeMove and keyAfter.
+    template <bool chess960>
+    [[nodiscard]] CastlingRights castlingRightsAfter(const Move &move) const;
+
     std::vector<State> prev_states_;
 
+    CheckInfo check_info_;
+
     U64 pieces_bb_[2][6];
 
     std::array<Piece, 64> board_;
@@ -1035,6 +1485,8 @@ inline void Board::setFen(std::string fen) {
     castling_rights_.clearAllCastlingRights();
 
     for (char i : castling) {
+        if (i == '-') continue;
+
         if (!chess960_) {
             if (i == 'K')
                 castling_rights_
@@ -1070,6 +1522,8 @@ inline void Board::setFen(std::string fen) {
     hash_key_ = zobrist();
     occ_all_ = all();
 
+    updateCheckInfo();
+
     prev_states_.clear();
     prev_states_.reserve(150);
 }
@@ -1216,60 +1670,78 @@ inline std::ostream &operator<<(std::ostream &os, const Board &b) {
 [[nodiscard]] inline bool Board::isRepetition(int count) const {
     uint8_t c = 0;
 
+#ifdef CHESS_STATS
+    int scanned = 0;
+    const auto record = [&scanned]() {
+        stats::local().repetition_calls++;
+        stats::local().repetition_scan[std::min(scanned, stats::MAX_REPETITION_SCAN)]++;
+    };
+#endif
+
     for (int i = static_cast<int>(prev_states_.size()) - 2;
          i >= 0 && i >= static_cast<int>(prev_states_.size()) - half_moves_ - 1; i -= 2) {
+        CHESS_STAT(scanned++);
+
         if (prev_states_[i].hash == hash_key_) c++;
 
-        if (c == count) return true;
+        if (c == count) {
+            CHESS_STAT(record());
+            return true;
+        }
     }
 
+    CHESS_STAT(record());
+
     return false;
 }
 
 [[nodiscard]] inline std::pair<std::string, GameResult> Board::isGameOver() const {
-    if (half_moves_ >= 100) {
-        const Board &board = *this;
+    // indexed by GameResultReason
+    static constexpr const char *REASONS[] = {"checkmate",
+                                              "stalemate",
+                                              "insufficient material",
+                                              "50 move rule",
+                                              "threefold repetition",
+                                              ""};
+
+    const auto [reason, result] = isGameOverReason();
+    return {REASONS[static_cast<int>(reason)], result};
+}
 
-        Movelist movelist;
-        movegen::legalmoves<MoveGenType::ALL>(movelist, board);
-        if (isAttacked(kingSq(side_to_move_), ~side_to_move_) && movelist.size() == 0) {
-            return {"checkmate", GameResult::LOSE};
+[[nodiscard]] inline std::pair<GameResultReason, GameResult> Board::isGameOverReason() const {
+    if (half_moves_ >= 100) {
+        if (inCheck() && !movegen::hasLegalMove(*this)) {
+            return {GameResultReason::CHECKMATE, GameResult::LOSE};
         }
-        return {"50 move rule", GameResult::DRAW};
+        return {GameResultReason::FIFTY_MOVE_RULE, GameResult::DRAW};
     }
 
     const auto count = builtin::popcount(occ());
 
-    if (count == 2) return {"insufficient material", GameResult::DRAW};
+    if (count == 2) return {GameResultReason::INSUFFICIENT_MATERIAL, GameResult::DRAW};
 
     if (count == 3) {
         if (pieces(PieceType::BISHOP, Color::WHITE) || pieces(PieceType::BISHOP, Color::BLACK))
-            return {"insufficient material", GameResult::DRAW};
+            return {GameResultReason::INSUFFICIENT_MATERIAL, GameResult::DRAW};
         if (pieces(PieceType::KNIGHT, Color::WHITE) || pieces(PieceType::KNIGHT, Color::BLACK))
-            return {"insufficient material", GameResult::DRAW};
+            return {GameResultReason::INSUFFICIENT_MATERIAL, GameResult::DRAW};
     }
 
     if (count == 4) {
         if (pieces(PieceType::BISHOP, Color::WHITE) && pieces(PieceType::BISHOP, Color::BLACK) &&
             utils::sameColor(builtin::lsb(pieces(PieceType::BISHOP, Color::WHITE)),
                              builtin::lsb(pieces(PieceType::BISHOP, Color::BLACK))))
-            return {"insufficient material", GameResult::DRAW};
+            return {GameResultReason::INSUFFICIENT_MATERIAL, GameResult::DRAW};
     }
 
-    if (isRepetition()) return {"threefold repetition", GameResult::DRAW};
-
-    const Board &board = *this;
+    if (isRepetition()) return {GameResultReason::THREEFOLD_REPETITION, GameResult::DRAW};
 
-    Movelist movelist;
-    movegen::legalmoves<MoveGenType::ALL>(movelist, board);
-
-    if (movelist.size() == 0) {
-        if (isAttacked(kingSq(side_to_move_), ~side_to_move_))
-            return {"checkmate", GameResult::LOSE};
-        return {"stalemate", GameResult::DRAW};
+    if (!movegen::hasLegalMove(*this)) {
+        if (inCheck()) return {GameResultReason::CHECKMATE, GameResult::LOSE};
+        return {GameResultReason::STALEMATE, GameResult::DRAW};
     }
 
-    return {"", GameResult::NONE};
+    return {GameResultReason::NONE, GameResult::NONE};
 }
 
 [[nodiscard]] inline bool Board::isAttacked(Square square, Color color) const {
@@ -1286,8 +1758,88 @@ inline std::ostream &operator<<(std::ostream &os, const Board &b) {
     return false;
 }
 
-[[nodiscard]] inline bool Board::inCheck() const {
-    return isAttacked(kingSq(side_to_move_), ~side_to_move_);
+[[nodiscard]] inline Bitboard Board::attackersTo(Square square, Bitboard occupied) const {
+    const Bitboard queens = pieces(PieceType::QUEEN);
+
+    return (movegen::attacks::pawn(Color::BLACK, square) & pieces(PieceType::PAWN, Color::WHITE)) |
+           (movegen::attacks::pawn(Color::WHITE, square) & pieces(PieceType::PAWN, Color::BLACK)) |
+           (movegen::attacks::knight(square) & pieces(PieceType::KNIGHT)) |
+           (movegen::attacks::bishop(square, occupied) & (pieces(PieceType::BISHOP) | queens)) |
+           (movegen::attacks::rook(square, occupied) & (pieces(PieceType::ROOK) | queens)) |
+           (movegen::attacks::king(square) & pieces(PieceType::KING));
+}
+
+/*
+ Swap algorithm: both sides capture on the target square with their least
+ valuable attacker until one side runs out of attackers or stops because it
+ would lose. Removing an attacker from the occupancy uncovers the sliders
+ behind it, so x-rays are found by looking up the sliders again.
+ */
+[[nodiscard]] inline bool Board::see(const Move &move, int threshold) const {
+    if (move.typeOf() != Move::NORMAL) return 0 >= threshold;
+
+    const Square from = move.from();
+    const Square to = move.to();
+
+    int swap = PIECE_VALUE[static_cast<int>(at<PieceType>(to))] - threshold;
+    if (swap < 0) return false;
+
+    swap = PIECE_VALUE[static_cast<int>(at<PieceType>(from))] - swap;
+    if (swap <= 0) return true;
+
+    const Bitboard bishops = pieces(PieceType::BISHOP) | pieces(PieceType::QUEEN);
+    const Bitboard rooks = pieces(PieceType::ROOK) | pieces(PieceType::QUEEN);
+
+    Bitboard occ = occ_all_ ^ (1ULL << from) ^ (1ULL << to);
+    Bitboard attackers = attackersTo(to, occ);
+    Color stm = color(at(from));
+    int res = 1;
+
+    while (true) {
+        stm = ~stm;
+        attackers &= occ;
+
+        const Bitboard stm_attackers = attackers & us(stm);
+        if (!stm_attackers) break;
+
+        res ^= 1;
+
+        Bitboard bb;
+
+        if ((bb = stm_attackers & pieces(PieceType::PAWN))) {
+            if ((swap = PIECE_VALUE[static_cast<int>(PieceType::PAWN)] - swap) < res) break;
+            occ ^= 1ULL << builtin::lsb(bb);
+            attackers |= movegen::attacks::bishop(to, occ) & bishops;
+        } else if ((bb = stm_attackers & pieces(PieceType::KNIGHT))) {
+            if ((swap = PIECE_VALUE[static_cast<int>(PieceType::KNIGHT)] - swap) < res) break;
+            occ ^= 1ULL << builtin::lsb(bb);
+        } else if ((bb = stm_attackers & pieces(PieceType::BISHOP))) {
+            if ((swap = PIECE_VALUE[static_cast<int>(PieceType::BISHOP)] - swap) < res) break;
+            occ ^= 1ULL << builtin::lsb(bb);
+            attackers |= movegen::attacks::bishop(to, occ) & bishops;
+        } else if ((bb = stm_attackers & pieces(PieceType::ROOK))) {
+            if ((swap = PIECE_VALUE[static_cast<int>(PieceType::ROOK)] - swap) < res) break;
+            occ ^= 1ULL << builtin::lsb(bb);
+            attackers |= movegen::attacks::rook(to, occ) & rooks;
+        } else if ((bb = stm_attackers & pieces(PieceType::QUEEN))) {
+            if ((swap = PIECE_VALUE[static_cast<int>(PieceType::QUEEN)] - swap) < res) break;
+            occ ^= 1ULL << builtin::lsb(bb);
+            attackers |= (movegen::attacks::bishop(to, occ) & bishops) |
+                         (movegen::attacks::rook(to, occ) & rooks);
+        } else {
+            // the king may only capture last
+            return (attackers & ~us(stm)) ? res ^ 1 : res;
+        }
+    }
+
+    return bool(res);
+}
+
+[[nodiscard]] inline bool Board::inCheck() const { return check_info_.checkers != 0ULL; }
+
+inline void Board::updateCheckInfo() {
+    check_info_ = side_to_move_ == Color::WHITE ? movegen::checkInfo<Color::WHITE>(*this)
+                                                : movegen::checkInfo<Color::BLACK>(*this);
 }
 
 inline void Board::placePiece(Piece piece, Square sq) {
@@ -1324,14 +1876,71 @@ inline void Board::removePiece(Piece piece, Square sq) {
     return piece;
 }
 
+template <bool chess960>
+inline CastlingRights Board::castlingRightsAfter(const Move &move) const {
+    CastlingRights rights = castling_rights_;
+
+    const Piece captured = at(move.to());
+    const PieceType pt = at<PieceType>(move.from());
+
+    if (captured != Piece::NONE && move.typeOf() != Move::CASTLING) {
+        const auto rank = utils::squareRank(move.to());
+
+        if constexpr (!chess960) {
+            // standard rooks only castle from the corners
+            if (move.to() == utils::relativeSquare(~side_to_move_, Square::SQ_H1))
+                rights.clearCastlingRight(~side_to_move_, CastleSide::KING_SIDE);
+            else if (move.to() == utils::relativeSquare(~side_to_move_, Square::SQ_A1))
+                rights.clearCastlingRight(~side_to_move_, CastleSide::QUEEN_SIDE);
+        } else if (utils::typeOfPiece(captured) == PieceType::ROOK &&
+                   ((rank == Rank::RANK_1 && side_to_move_ == Color::BLACK) ||
+                    (rank == Rank::RANK_8 && side_to_move_ == Color::WHITE))) {
+            const auto king_sq = kingSq(~side_to_move_);
+
+            rights.clearCastlingRight(~side_to_move_, move.to() > king_sq
+                                                          ? CastleSide::KING_SIDE
+                                                          : CastleSide::QUEEN_SIDE);
+        }
+    }
+
+    if (pt == PieceType::KING) {
+        rights.clearCastlingRight(side_to_move_);
+    } else if (pt == PieceType::ROOK) {
+        if constexpr (!chess960) {
+            if (move.from() == utils::relativeSquare(side_to_move_, Square::SQ_H1))
+                rights.clearCastlingRight(side_to_move_, CastleSide::KING_SIDE);
+            else if (move.from() == utils::relativeSquare(side_to_move_, Square::SQ_A1))
+                rights.clearCastlingRight(side_to_move_, CastleSide::QUEEN_SIDE);
+        } else if (utils::ourBackRank(move.from(), side_to_move_)) {
+            const auto king_sq = kingSq(side_to_move_);
+
+            rights.clearCastlingRight(side_to_move_, move.from() > king_sq
+                                                         ? CastleSide::KING_SIDE
+                                                         : CastleSide::QUEEN_SIDE);
+        }
+    }
+
+    return rights;
+}
+
+inline void Board::makeMove(const Move &move) {
+    if (chess960_)
+        makeMove<true>(move);
+    else
+        makeMove<false>(move);
+}
+
+template <bool chess960>
 inline void Board::makeMove(const Move &move) {
+    CHESS_STAT(stats::local().make_move[move.typeOf() >> 14]++);
+
     auto capture = at(move.to()) != Piece::NONE && move.typeOf() != Move::CASTLING;
     auto captured = at(move.to());
     const auto pt = at<PieceType>(move.from());
 
     // captured);
     prev_states_.emplace_back(
-        State{hash_key_, castling_rights_, enpassant_sq_, half_moves_, captured});
+        State{hash_key_, castling_rights_, enpassant_sq_, half_moves_, captured, check_info_});
 
     half_moves_++;
     full_moves_++;
@@ -1341,32 +1950,15 @@ inline void Board::makeMove(const Move &move) {
 
     hash_key_ ^= zobrist::castling(castling_rights_.getHashIndex());
 
+    castling_rights_ = castlingRightsAfter<chess960>(move);
+
     if (capture) {
         half_moves_ = 0;
 
         removePiece(captured, move.to());
-
-        const auto rank = utils::squareRank(move.to());
-
-        if (utils::typeOfPiece(captured) == PieceType::ROOK &&
-            ((rank == Rank::RANK_1 && side_to_move_ == Color::BLACK) ||
-             (rank == Rank::RANK_8 && side_to_move_ == Color::WHITE))) {
-            const auto king_sq = kingSq(~side_to_move_);
-
-            castling_rights_.clearCastlingRight(~side_to_move_, move.to() > king_sq
-                                                                    ? CastleSide::KING_SIDE
-                                                                    : CastleSide::QUEEN_SIDE);
-        }
     }
 
-    if (pt == PieceType::KING) {
-        castling_rights_.clearCastlingRight(side_to_move_);
-    } else if (pt == PieceType::ROOK && utils::ourBackRank(move.from(), side_to_move_)) {
-        const auto king_sq = kingSq(side_to_move_);
-
-        castling_rights_.clearCastlingRight(
-            side_to_move_, move.from() > king_sq ? CastleSide::KING_SIDE : CastleSide::QUEEN_SIDE);
-    } else if (pt == PieceType::PAWN) {
+    if (pt == PieceType::PAWN) {
         half_moves_ = 0;
 
         const auto possible_ep = static_cast<Square>(move.to() ^ 8);
@@ -1419,15 +2011,20 @@ inline void Board::makeMove(const Move &move) {
     hash_key_ ^= zobrist::castling(castling_rights_.getHashIndex());
 
     side_to_move_ = ~side_to_move_;
+
+    updateCheckInfo();
 }
 
 inline void Board::unmakeMove(const Move &move) {
+    CHESS_STAT(stats::local().unmake_move++);
+
     const auto prev = prev_states_.back();
     prev_states_.pop_back();
 
     enpassant_sq_ = prev.enpassant;
     castling_rights_ = prev.castling;
     half_moves_ = prev.half_moves;
+    check_info_ = prev.check_info;
 
     full_moves_--;
 
@@ -1497,7 +2094,7 @@ inline void Board::unmakeMove(const Move &move) {
 
 inline void Board::makeNullMove() {
     prev_states_.emplace_back(
-        State{hash_key_, castling_rights_, enpassant_sq_, half_moves_, Piece::NONE});
+        State{hash_key_, castling_rights_, enpassant_sq_, half_moves_, Piece::NONE, check_info_});
 
     hash_key_ ^= zobrist::sideToMove();
     if (enpassant_sq_ != NO_SQ) hash_key_ ^= zobrist::enpassant(utils::squareFile(enpassant_sq_));
@@ -1506,6 +2103,8 @@ inline void Board::makeNullMove() {
     side_to_move_ = ~side_to_move_;
 
     full_moves_++;
+
+    updateCheckInfo();
 }
 
 inline void Board::unmakeNullMove() {
@@ -1515,6 +2114,7 @@ inline void Board::unmakeNullMove() {
     castling_rights_ = prev.castling;
     half_moves_ = prev.half_moves;
     hash_key_ = prev.hash;
+    check_info_ = prev.check_info;
 
     full_moves_--;
 
@@ -1527,24 +2127,43 @@ inline void Board::unmakeNullMove() {
 
 namespace movegen {
 
-static constexpr Bitboard MASK_RANK[8] = {
+inline constexpr Bitboard MASK_RANK[8] = {
     0xff,         0xff00,         0xff0000,         0xff000000,
     0xff00000000, 0xff0000000000, 0xff000000000000, 0xff00000000000000};
 
-static constexpr Bitboard MASK_FILE[8] = {
+inline constexpr Bitboard MASK_FILE[8] = {
     0x101010101010101,  0x202020202020202,  0x404040404040404,  0x808080808080808,
     0x1010101010101010, 0x2020202020202020, 0x4040404040404040, 0x8080808080808080,
 };
 
+#ifdef CHESS_USE_PEXT
+
+// PEXT indexes the attack table directly with the occupancy bits on the mask,
+// so neither the magic number nor the shift is needed.
+struct Magic {
+    Bitboard mask;
+    const Bitboard *attacks;
+
+    U64 operator()(U64 b) const { return _pext_u64(b, mask); }
+};
+
+constexpr bool USE_PEXT = true;
+
+#else
+
 struct Magic {
     Bitboard mask;
     U64 magic;
-    U64 *attacks;
+    const Bitboard *attacks;
     U64 shift;
 
     U64 operator()(U64 b) const { return ((b & mask) * magic) >> shift; }
 };
 
+constexpr bool USE_PEXT = false;
+
+#endif
+
 constexpr Bitboard RookMagics[MAX_SQ] = {
     0x8a80104000800020ULL, 0x140002000100040ULL,  0x2801880a0017001ULL,  0x100081001000420ULL,
     0x200020010080420ULL,  0x3001c0002010008ULL,  0x8480008002000100ULL, 0x2080088004402900ULL,
@@ -1581,12 +2200,6 @@ constexpr Bitboard BishopMagics[MAX_SQ] = {
     0xa010109502200ULL,    0x4a02012000ULL,       0x500201010098b028ULL, 0x8040002811040900ULL,
     0x28000010020204ULL,   0x6000020202d0240ULL,  0x8918844842082200ULL, 0x4010011029020020ULL};
 
-inline Bitboard RookAttacks[0x19000] = {};
-inline Bitboard BishopAttacks[0x1480] = {};
-
-inline Magic RookTable[MAX_SQ] = {};
-inline Magic BishopTable[MAX_SQ] = {};
-
 [[nodiscard]] inline int validSq(Rank r, File f) {
     return r >= Rank::RANK_1 && r <= Rank::RANK_8 && f >= File::FILE_A && f <= File::FILE_H;
 }
@@ -1669,45 +2282,157 @@ namespace runtime {
 
 }  // namespace runtime
 
-inline void initSliders(Square sq, Magic table[], U64 magic,
-                        std::function<Bitboard(Square, Bitboard)> attacks) {
+// squares a slider attacks on an empty board, indexed by direction and square
+inline constexpr std::array<std::array<Bitboard, MAX_SQ>, 8> SLIDER_RAYS = []() constexpr {
+    // north, south, east, west, north east, south west, north west, south east
+    constexpr int dr[8] = {1, -1, 0, 0, 1, -1, 1, -1};
+    constexpr int df[8] = {0, 0, 1, -1, 1, -1, -1, 1};
+
+    std::array<std::array<Bitboard, MAX_SQ>, 8> rays{};
+    for (int dir = 0; dir < 8; dir++) {
+        for (int sq = 0; sq < MAX_SQ; sq++) {
+            int r = sq / 8 + dr[dir];
+            int f = sq % 8 + df[dir];
+            for (; r >= 0 && r < 8 && f >= 0 && f < 8; r += dr[dir], f += df[dir]) {
+                rays[dir][sq] |= 1ULL << (r * 8 + f);
+            }
+        }
+    }
+    return rays;
+}();
+
+/// @brief Attacks along the four rays of a slider, rays[0] and rays[2] walk towards the
+/// higher squares, rays[1] and rays[3] towards the lower squares.
+[[nodiscard]] constexpr Bitboard rayAttacks(const Bitboard (&rays)[4], Bitboard occupied) {
+    Bitboard attacks = 0ULL;
+
+    for (int i = 0; i < 4; i++) {
+        Bitboard ray = rays[i];
+        Bitboard blockers = ray & occupied;
+
+        if (blockers) {
+            // keep the ray up to and including the nearest blocker
+            if (i % 2 == 0) {
+                ray &= ((blockers & (0 - blockers)) << 1) - 1;
+            } else {
+                while (blockers & (blockers - 1)) blockers &= blockers - 1;
+                ray &= ~(blockers - 1);
+            }
+        }
+
+        attacks |= ray;
+    }
+
+    return attacks;
+}
+
+template <PieceType pt>
+constexpr void sliderRays(Square sq, Bitboard (&rays)[4]) {
+    static_assert(pt == PieceType::BISHOP || pt == PieceType::ROOK);
+
+    // rays 0-3 of SLIDER_RAYS are the rook rays, 4-7 the bishop rays
+    constexpr int first = pt == PieceType::ROOK ? 0 : 4;
+
+    for (int i = 0; i < 4; i++) rays[i] = SLIDER_RAYS[first + i][sq];
+}
+
+/// @brief Same result as runtime::bishopAttacks/rookAttacks, but cheap enough
+/// to fill the attack tables in a constant expression.
+template <PieceType pt>
+[[nodiscard]] constexpr Bitboard sliderAttacks(Square sq, Bitboard occupied) {
+    Bitboard rays[4] = {};
+    sliderRays<pt>(sq, rays);
+    return rayAttacks(rays, occupied);
+}
+
+/// @brief Relevant occupancy of a slider, the edges never block it.
+template <PieceType pt>
+[[nodiscard]] constexpr Bitboard sliderMask(Square sq) {
     const Bitboard edges =
         ((MASK_RANK[static_cast<int>(Rank::RANK_1)] | MASK_RANK[static_cast<int>(Rank::RANK_8)]) &
          ~MASK_RANK[static_cast<int>(utils::squareRank(sq))]) |
         ((MASK_FILE[static_cast<int>(File::FILE_A)] | MASK_FILE[static_cast<int>(File::FILE_H)]) &
          ~MASK_FILE[static_cast<int>(utils::squareFile(sq))]);
 
-    Bitboard occ = 0ULL;
+    return sliderAttacks<pt>(sq, 0ULL) & ~edges;
+}
 
-    table[sq].magic = magic;
-    table[sq].mask = attacks(sq, occ) & ~edges;
-    table[sq].shift = MAX_SQ - builtin::popcount(table[sq].mask);
+// builtin::popcount is not usable in constant expressions on every compiler
+[[nodiscard]] constexpr int sliderBits(Bitboard mask) {
+    int bits = 0;
+    for (; mask; mask &= mask - 1) bits++;
+    return bits;
+}
 
-    if (sq < MAX_SQ - 1) {
-        table[sq + 1].attacks = table[sq].attacks + (1 << builtin::popcount(table[sq].mask));
-    }
+template <PieceType pt>
+[[nodiscard]] constexpr U64 sliderMagic(Square sq) {
+    return pt == PieceType::ROOK ? RookMagics[sq] : BishopMagics[sq];
+}
+
+/// @brief Attack table of one slider square, indexed like Magic::operator().
+template <PieceType pt, Square sq>
+[[nodiscard]] constexpr auto initSliderAttacks() {
+    constexpr Bitboard mask = sliderMask<pt>(sq);
+    constexpr int bits = sliderBits(mask);
+
+    std::array<Bitboard, std::size_t(1) << bits> table{};
+
+    Bitboard rays[4] = {};
+    sliderRays<pt>(sq, rays);
+
+    // The carry rippler visits the subsets of the mask in PEXT index order.
+    Bitboard occ = 0ULL;
+    std::size_t subset = 0;
 
     do {
-        table[sq].attacks[table[sq](occ)] = attacks(sq, occ);
-        occ = (occ - table[sq].mask) & table[sq].mask;
+        const std::size_t index =
+            USE_PEXT ? subset : std::size_t((occ * sliderMagic<pt>(sq)) >> (MAX_SQ - bits));
+        table[index] = rayAttacks(rays, occ);
+        occ = (occ - mask) & mask;
+        subset++;
     } while (occ);
+
+    return table;
 }
 
-inline void initAttacks() {
-    BishopTable[0].attacks = BishopAttacks;
-    RookTable[0].attacks = RookAttacks;
+/*
+ Every square gets its own table, so that each one is a separate constant
+ expression and stays well below the constexpr evaluation limits of the compilers.
+ The tables end up in .rodata, there is no initialisation at startup and
+ exactly one copy per binary.
+ */
+template <Square sq>
+inline constexpr auto RookAttacks = initSliderAttacks<PieceType::ROOK, sq>();
+
+template <Square sq>
+inline constexpr auto BishopAttacks = initSliderAttacks<PieceType::BISHOP, sq>();
+
+template <PieceType pt, Square sq>
+[[nodiscard]] constexpr Magic initMagic() {
+    constexpr Bitboard mask = sliderMask<pt>(sq);
+
+    const Bitboard *attacks = nullptr;
+    if constexpr (pt == PieceType::ROOK)
+        attacks = RookAttacks<sq>.data();
+    else
+        attacks = BishopAttacks<sq>.data();
 
-    for (int i = 0; i < MAX_SQ; i++) {
-        initSliders(static_cast<Square>(i), BishopTable, BishopMagics[i], runtime::bishopAttacks);
-        initSliders(static_cast<Square>(i), RookTable, RookMagics[i], runtime::rookAttacks);
-    }
+#ifdef CHESS_USE_PEXT
+    return Magic{mask, attacks};
+#else
+    return Magic{mask, sliderMagic<pt>(sq), attacks, U64(MAX_SQ - sliderBits(mask))};
+#endif
 }
 
-// force initialization of attacks
-static auto init = []() {
-    initAttacks();
-    return 0;
-}();
+template <PieceType pt, std::size_t... sq>
+[[nodiscard]] constexpr std::array<Magic, MAX_SQ> initMagics(std::index_sequence<sq...>) {
+    return {initMagic<pt, static_cast<Square>(sq)>()...};
+}
+
+inline constexpr std::array<Magic, MAX_SQ> RookTable =
+    initMagics<PieceType::ROOK>(std::make_index_sequence<MAX_SQ>());
+inline constexpr std::array<Magic, MAX_SQ> BishopTable =
+    initMagics<PieceType::BISHOP>(std::make_index_sequence<MAX_SQ>());
 
 template <Direction direction>
 [[nodiscard]] constexpr Bitboard shift(const Bitboard b) {
@@ -1733,7 +2458,7 @@ template <Direction direction>
 
 // clang-format off
 // pre-calculated lookup table for pawn attacks
-static constexpr Bitboard PawnAttacks[2][MAX_SQ] = {
+inline constexpr Bitboard PawnAttacks[2][MAX_SQ] = {
     // white pawn attacks
     { 0x200, 0x500, 0xa00, 0x1400,
       0x2800, 0x5000, 0xa000, 0x4000,
@@ -1775,7 +2500,7 @@ static constexpr Bitboard PawnAttacks[2][MAX_SQ] = {
 // clang-format on
 
 // pre-calculated lookup table for knight attacks
-static constexpr Bitboard KnightAttacks[MAX_SQ] = {
+inline constexpr Bitboard KnightAttacks[MAX_SQ] = {
     0x0000000000020400, 0x0000000000050800, 0x00000000000A1100, 0x0000000000142200,
     0x0000000000284400, 0x0000000000508800, 0x0000000000A01000, 0x0000000000402000,
     0x0000000002040004, 0x0000000005080008, 0x000000000A110011, 0x0000000014220022,
@@ -1794,7 +2519,7 @@ static constexpr Bitboard KnightAttacks[MAX_SQ] = {
     0x0044280000000000, 0x0088500000000000, 0x0010A00000000000, 0x0020400000000000};
 
 // pre-calculated lookup table for king attacks
-static constexpr Bitboard KingAttacks[MAX_SQ] = {
+inline constexpr Bitboard KingAttacks[MAX_SQ] = {
     0x0000000000000302, 0x0000000000000705, 0x0000000000000E0A, 0x0000000000001C14,
     0x0000000000003828, 0x0000000000007050, 0x000000000000E0A0, 0x000000000000C040,
     0x0000000000030203, 0x0000000000070507, 0x00000000000E0A0E, 0x00000000001C141C,
@@ -1832,31 +2557,158 @@ namespace attacks {
 
 [[nodiscard]] inline Bitboard king(Square sq) { return KingAttacks[sq]; }
 
+/*
+ Kogge-Stone occluded fill, every SIMD lane floods one direction.
+ A direction shifts by n, the propagator starts out as the empty squares without the
+ squares a shift by n would wrap onto, so after the three doubling steps the fill
+ never crosses the edge of the board.
+ */
+#if defined(CHESS_USE_AVX512)
+
+/// @brief Union of the attacks of all bishops and all rooks, queens belong to both sets.
+[[nodiscard]] inline Bitboard slidersAll(Bitboard bishops, Bitboard rooks, Bitboard occupied) {
+    constexpr Bitboard NOT_A = ~MASK_FILE[0];
+    constexpr Bitboard NOT_H = ~MASK_FILE[7];
+    constexpr Bitboard NOT_1 = ~MASK_RANK[0];
+    constexpr Bitboard NOT_8 = ~MASK_RANK[7];
+
+    // north, east, north east, north west, south, west, south west, south east
+    // Rotating instead of shifting lets one instruction serve both shift directions,
+    // the squares a rotation wraps onto are removed by the rank masks.
+    // The zero masking forms are used on purpose, GCC's plain rolv, andnot and reduce
+    // take an undefined vector as pass-through and warn with -Wmaybe-uninitialized.
+    const __m512i rot1 = _mm512_setr_epi64(8, 1, 9, 7, 56, 63, 55, 57);
+    const __m512i rot2 = _mm512_setr_epi64(16, 2, 18, 14, 48, 62, 46, 50);
+    const __m512i rot4 = _mm512_setr_epi64(32, 4, 36, 28, 32, 60, 28, 36);
+    const __m512i wrap = _mm512_setr_epi64(
+        static_cast<long long>(NOT_1), static_cast<long long>(NOT_A),
+        static_cast<long long>(NOT_A & NOT_1), static_cast<long long>(NOT_H & NOT_1),
+        static_cast<long long>(NOT_8), static_cast<long long>(NOT_H),
+        static_cast<long long>(NOT_H & NOT_8), static_cast<long long>(NOT_A & NOT_8));
+
+    const auto r = static_cast<long long>(rooks);
+    const auto b = static_cast<long long>(bishops);
+
+    __m512i gen = _mm512_setr_epi64(r, r, b, b, r, r, b, b);
+    __m512i pro = _mm512_and_si512(_mm512_set1_epi64(static_cast<long long>(~occupied)), wrap);
+
+    const auto rol = [](__m512i v, __m512i n) { return _mm512_maskz_rolv_epi64(0xFF, v, n); };
+
+    gen = _mm512_or_si512(gen, _mm512_and_si512(pro, rol(gen, rot1)));
+    pro = _mm512_and_si512(pro, rol(pro, rot1));
+    gen = _mm512_or_si512(gen, _mm512_and_si512(pro, rol(gen, rot2)));
+    pro = _mm512_and_si512(pro, rol(pro, rot2));
+    gen = _mm512_or_si512(gen, _mm512_and_si512(pro, rol(gen, rot4)));
+
+    const __m512i attacks = _mm512_and_si512(rol(gen, rot1), wrap);
+    const __m256i quad = _mm256_or_si256(_mm512_maskz_extracti64x4_epi64(0xF, attacks, 0),
+                                         _mm512_maskz_extracti64x4_epi64(0xF, attacks, 1));
+    const __m128i half =
+        _mm_or_si128(_mm256_castsi256_si128(quad), _mm256_extracti128_si256(quad, 1));
+
+    return static_cast<Bitboard>(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+}
+
+constexpr const char *SLIDERS_ALL_BACKEND = "avx512";
+
+#elif defined(CHESS_USE_AVX2)
+
+[[nodiscard]] inline __m256i fillLeft(__m256i gen, __m256i pro, __m256i shift) {
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+    pro = _mm256_and_si256(pro, _mm256_sllv_epi64(pro, shift));
+    shift = _mm256_add_epi64(shift, shift);
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+    pro = _mm256_and_si256(pro, _mm256_sllv_epi64(pro, shift));
+    shift = _mm256_add_epi64(shift, shift);
+    return _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+}
+
+[[nodiscard]] inline __m256i fillRight(__m256i gen, __m256i pro, __m256i shift) {
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+    pro = _mm256_and_si256(pro, _mm256_srlv_epi64(pro, shift));
+    shift = _mm256_add_epi64(shift, shift);
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+    pro = _mm256_and_si256(pro, _mm256_srlv_epi64(pro, shift));
+    shift = _mm256_add_epi64(shift, shift);
+    return _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+}
+
+/// @brief Union of the attacks of all bishops and all rooks, queens belong to both sets.
+[[nodiscard]] inline Bitboard slidersAll(Bitboard bishops, Bitboard rooks, Bitboard occupied) {
+    constexpr auto NOT_A = static_cast<long long>(~MASK_FILE[0]);
+    constexpr auto NOT_H = static_cast<long long>(~MASK_FILE[7]);
+
+    // north, east, north east, north west
+    const __m256i shift = _mm256_setr_epi64x(8, 1, 9, 7);
+    const __m256i wrap_left = _mm256_setr_epi64x(-1, NOT_A, NOT_A, NOT_H);
+    // south, west, south west, south east
+    const __m256i wrap_right = _mm256_setr_epi64x(-1, NOT_H, NOT_H, NOT_A);
+
+    const auto r = static_cast<long long>(rooks);
+    const auto b = static_cast<long long>(bishops);
+
+    const __m256i gen = _mm256_setr_epi64x(r, r, b, b);
+    const __m256i empty = _mm256_set1_epi64x(static_cast<long long>(~occupied));
+
+    const __m256i left = _mm256_and_si256(
+        _mm256_sllv_epi64(fillLeft(gen, _mm256_and_si256(empty, wrap_left), shift), shift),
+        wrap_left);
+    const __m256i right = _mm256_and_si256(
+        _mm256_srlv_epi64(fillRight(gen, _mm256_and_si256(empty, wrap_right), shift), shift),
+        wrap_right);
+
+    const __m256i attacks = _mm256_or_si256(left, right);
+    const __m128i half =
+        _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+
+    return static_cast<Bitboard>(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+}
+
+constexpr const char *SLIDERS_ALL_BACKEND = "avx2";
+
+#else
+
+/// @brief Union of the attacks of all bishops and all rooks, queens belong to both sets.
+[[nodiscard]] inline Bitboard slidersAll(Bitboard bishops, Bitboard rooks, Bitboard occupied) {
+    Bitboard attacks = 0ULL;
+
+    while (bishops) attacks |= bishop(builtin::poplsb(bishops), occupied);
+    while (rooks) attacks |= rook(builtin::poplsb(rooks), occupied);
+
+    return attacks;
+}
+
+constexpr const char *SLIDERS_ALL_BACKEND = "scalar";
+
+#endif
+
+/// @brief Union of the attacks of all sliders, every slider attacks in all eight directions.
+[[nodiscard]] inline Bitboard slidersAll(Bitboard sliders, Bitboard occupied) {
+    return slidersAll(sliders, sliders, occupied);
+}
+
 }  // namespace attacks
 
-// force initialization of squares between
-static auto init_squares_between = []() constexpr {
-    // initialize squares between table
+// pre-calculated lookup table for the squares between two squares on a line
+inline constexpr std::array<std::array<U64, MAX_SQ>, MAX_SQ> SQUARES_BETWEEN_BB = []() constexpr {
     std::array<std::array<U64, MAX_SQ>, MAX_SQ> squares_between_bb{};
-    U64 sqs = 0;
     for (Square sq1 = Square::SQ_A1; sq1 <= Square::SQ_H8; ++sq1) {
         for (Square sq2 = Square::SQ_A1; sq2 <= Square::SQ_H8; ++sq2) {
-            sqs = (1ULL << sq1) | (1ULL << sq2);
+            const U64 sqs = (1ULL << sq1) | (1ULL << sq2);
             if (sq1 == sq2)
                 squares_between_bb[sq1][sq2] = 0ull;
             else if (utils::squareFile(sq1) == utils::squareFile(sq2) ||
                      utils::squareRank(sq1) == utils::squareRank(sq2))
-                squares_between_bb[sq1][sq2] = attacks::rook(sq1, sqs) & attacks::rook(sq2, sqs);
+                squares_between_bb[sq1][sq2] = sliderAttacks<PieceType::ROOK>(sq1, sqs) &
+                                               sliderAttacks<PieceType::ROOK>(sq2, sqs);
             else if (utils::diagonalOf(sq1) == utils::diagonalOf(sq2) ||
                      utils::antiDiagonalOf(sq1) == utils::antiDiagonalOf(sq2))
-                squares_between_bb[sq1][sq2] =
-                    attacks::bishop(sq1, sqs) & attacks::bishop(sq2, sqs);
+                squares_between_bb[sq1][sq2] = sliderAttacks<PieceType::BISHOP>(sq1, sqs) &
+                                               sliderAttacks<PieceType::BISHOP>(sq2, sqs);
         }
     }
     return squares_between_bb;
-};
-
-static const std::array<std::array<U64, 64>, 64> SQUARES_BETWEEN_BB = init_squares_between();
+}();
 
 template <Color c>
 [[nodiscard]] Bitboard pawnLeftAttacks(const Bitboard pawns) {
@@ -1870,57 +2722,12 @@ template <Color c>
                              : (pawns >> 9) & ~MASK_FILE[static_cast<int>(File::FILE_H)];
 }
 
-template <Color c>
-[[nodiscard]] Bitboard checkMask(const Board &board, Square sq, int &double_check) {
-    Bitboard mask = 0;
-    double_check = 0;
-
-    const auto opp_knight = board.pieces(PieceType::KNIGHT, ~c);
-    const auto opp_bishop = board.pieces(PieceType::BISHOP, ~c);
-    const auto opp_rook = board.pieces(PieceType::ROOK, ~c);
-    const auto opp_queen = board.pieces(PieceType::QUEEN, ~c);
-
-    const auto opp_pawns = board.pieces(PieceType::PAWN, ~c);
-
-    // check for knight checks
-    Bitboard knight_attacks = attacks::knight(sq) & opp_knight;
-    double_check += bool(knight_attacks);
-
-    mask |= knight_attacks;
-
-    // check for pawn checks
-    Bitboard pawn_attacks = attacks::pawn(board.sideToMove(), sq) & opp_pawns;
-    mask |= pawn_attacks;
-    double_check += bool(pawn_attacks);
-
-    // check for bishop checks
-    Bitboard bishop_attacks = attacks::bishop(sq, board.occ()) & (opp_bishop | opp_queen);
-
-    if (bishop_attacks) {
-        const auto index = builtin::lsb(bishop_attacks);
-
-        mask |= SQUARES_BETWEEN_BB[sq][index] | (1ULL << index);
-        double_check++;
-    }
-
-    Bitboard rook_attacks = attacks::rook(sq, board.occ()) & (opp_rook | opp_queen);
-    if (rook_attacks) {
-        if (builtin::popcount(rook_attacks) > 1) {
-            double_check = 2;
-            return mask;
-        }
-
-        const auto index = builtin::lsb(rook_attacks);
-
-        mask |= SQUARES_BETWEEN_BB[sq][index] | (1ULL << index);
-        double_check++;
-    }
-
-    if (!mask) {
-        return DEFAULT_CHECKMASK;
-    }
+/// @brief Squares a non king move has to go to, the checker and the squares between it and the
+/// king, or every square when not in check.
+[[nodiscard]] inline Bitboard checkMask(Square sq, Bitboard checkers) {
+    if (!checkers) return DEFAULT_CHECKMASK;
 
-    return mask;
+    return SQUARES_BETWEEN_BB[sq][builtin::lsb(checkers)] | checkers;
 }
 
 template <Color c>
@@ -1963,7 +2770,55 @@ template <Color c>
     return pin_diag;
 }
 
+/// @brief Computes the checkers, pin rays and check squares for side c to move,
+/// Board::makeMove stores the result so move generation doesn't redo it.
 template <Color c>
+[[nodiscard]] CheckInfo checkInfo(const Board &board) {
+    const auto king_sq = board.kingSq(c);
+    const auto enemy_king_sq = board.kingSq(~c);
+    const auto occ_us = board.us(c);
+    const auto occ_enemy = board.us(~c);
+    const auto occ_all = board.occ();
+
+    const auto opp_queen = board.pieces(PieceType::QUEEN, ~c);
+    const auto opp_bishop = board.pieces(PieceType::BISHOP, ~c) | opp_queen;
+    const auto opp_rook = board.pieces(PieceType::ROOK, ~c) | opp_queen;
+
+    CheckInfo info;
+
+    info.checkers = (attacks::pawn(c, king_sq) & board.pieces(PieceType::PAWN, ~c)) |
+                    (attacks::knight(king_sq) & board.pieces(PieceType::KNIGHT, ~c)) |
+                    (attacks::bishop(king_sq, occ_all) & opp_bishop) |
+                    (attacks::rook(king_sq, occ_all) & opp_rook);
+
+    info.pin_hv = pinMaskRooks<c>(board, king_sq, occ_enemy, occ_us);
+    info.pin_d = pinMaskBishops<c>(board, king_sq, occ_enemy, occ_us);
+
+    info.check_squares[static_cast<int>(PieceType::PAWN)] = attacks::pawn(~c, enemy_king_sq);
+    info.check_squares[static_cast<int>(PieceType::KNIGHT)] = attacks::knight(enemy_king_sq);
+    info.check_squares[static_cast<int>(PieceType::BISHOP)] =
+        attacks::bishop(enemy_king_sq, occ_all);
+    info.check_squares[static_cast<int>(PieceType::ROOK)] = attacks::rook(enemy_king_sq, occ_all);
+
+    // our sliders behind exactly one of our own pieces, seen from the enemy king
+    const auto queen = board.pieces(PieceType::QUEEN, c);
+    Bitboard snipers = (attacks::bishop(enemy_king_sq, occ_enemy) &
+                        (board.pieces(PieceType::BISHOP, c) | queen)) |
+                       (attacks::rook(enemy_king_sq, occ_enemy) &
+                        (board.pieces(PieceType::ROOK, c) | queen));
+
+    info.discoverers = 0ULL;
+
+    while (snipers) {
+        const Square index = builtin::poplsb(snipers);
+        const Bitboard between = SQUARES_BETWEEN_BB[enemy_king_sq][index] & occ_us;
+        if (builtin::popcount(between) == 1) info.discoverers |= between;
+    }
+
+    return info;
+}
+
+template <Color c, bool chess960>
 [[nodiscard]] Bitboard seenSquares(const Board &board, Bitboard enemy_empty) {
     auto king_sq = board.kingSq(~c);
 
@@ -1977,7 +2832,7 @@ template <Color c>
 
     Bitboard map_king_atk = attacks::king(king_sq) & enemy_empty;
 
-    if (map_king_atk == 0ull && !board.chess960()) {
+    if (map_king_atk == 0ull && !chess960) {
         return 0ull;
     }
 
@@ -1990,15 +2845,7 @@ template <Color c>
         seen |= attacks::knight(index);
     }
 
-    while (bishops) {
-        const auto index = builtin::poplsb(bishops);
-        seen |= attacks::bishop(index, occ);
-    }
-
-    while (rooks) {
-        const auto index = builtin::poplsb(rooks);
-        seen |= attacks::rook(index, occ);
-    }
+    seen |= attacks::slidersAll(bishops, rooks, occ);
 
     const Square index = board.kingSq(c);
     seen |= attacks::king(index);
@@ -2006,9 +2853,82 @@ template <Color c>
     return seen;
 }
 
-template <Color c, MoveGenType mt>
-void generatePawnMoves(const Board &board, Movelist &moves, Bitboard pin_d, Bitboard pin_hv,
-                       Bitboard checkmask, Bitboard occ_enemy) {
+/// @brief Returns the pawns which can legally capture en passant.
+template <Color c>
+[[nodiscard]] Bitboard enpassantMoves(const Board &board, Bitboard pawns_lr, Bitboard pin_d,
+                                      Bitboard checkmask) {
+    constexpr Direction DOWN = c == Color::WHITE ? Direction::SOUTH : Direction::NORTH;
+
+    const Square ep = board.enpassantSq();
+    const Square epPawn = ep + DOWN;
+
+    const Bitboard ep_mask = (1ull << epPawn) | (1ull << ep);
+
+    /*
+     In case the en passant square and the enemy pawn
+     that just moved are not on the checkmask
+     en passant is not available.
+    */
+    if ((checkmask & ep_mask) == 0) return 0ull;
+
+    const Square kSQ = board.kingSq(c);
+    const Bitboard kingMask =
+        (1ull << kSQ) & MASK_RANK[static_cast<int>(utils::squareRank(epPawn))];
+    const Bitboard enemyQueenRook =
+        board.pieces(PieceType::ROOK, ~c) | board.pieces(PieceType::QUEEN, ~c);
+
+    const bool isPossiblePin = kingMask && enemyQueenRook;
+    Bitboard epBB = attacks::pawn(~c, ep) & pawns_lr;
+    Bitboard legal = 0ull;
+
+    // For one en passant square two pawns could potentially take there.
+
+    while (epBB) {
+        const Square from = builtin::poplsb(epBB);
+
+        /*
+         If the pawn is pinned but the en passant square is not on the
+         pin mask then the move is illegal.
+        */
+        if ((1ULL << from) & pin_d && !(pin_d & (1ull << ep))) continue;
+
+        const Bitboard connectingPawns = (1ull << epPawn) | (1ull << from);
+
+        /*
+         7k/4p3/8/2KP3r/8/8/8/8 b - - 0 1
+         If e7e5 there will be a potential ep square for us on e6.
+         However, we cannot take en passant because that would put our king
+         in check. For this scenario we check if there's an enemy rook/queen
+         that would give check if the two pawns were removed.
+         If that's the case then the move is illegal and we can break immediately.
+        */
+        if (isPossiblePin &&
+            (attacks::rook(kSQ, board.occ() & ~connectingPawns) & enemyQueenRook) != 0)
+            break;
+
+        legal |= (1ull << from);
+    }
+
+    return legal;
+}
+
+/*
+ The generators below hand every move to a visitor, which returns false to stop
+ the generation. They return false themselves once the visitor stopped them.
+ */
+
+/// @brief Visits the four promotions of a pawn move.
+template <typename F>
+[[nodiscard]] inline bool addPromotions(F &visit, Square from, Square to) {
+    return visit(Move::make<Move::PROMOTION>(from, to, PieceType::QUEEN)) &&
+           visit(Move::make<Move::PROMOTION>(from, to, PieceType::ROOK)) &&
+           visit(Move::make<Move::PROMOTION>(from, to, PieceType::BISHOP)) &&
+           visit(Move::make<Move::PROMOTION>(from, to, PieceType::KNIGHT));
+}
+
+template <Color c, MoveGenType mt, typename F>
+[[nodiscard]] bool generatePawnMoves(const Board &board, F &visit, Bitboard pin_d, Bitboard pin_hv,
+                                     Bitboard checkmask, Bitboard occ_enemy) {
     const auto pawns = board.pieces(PieceType::PAWN, c);
 
     constexpr Direction UP = c == Color::WHITE ? Direction::NORTH : Direction::SOUTH;
@@ -2066,26 +2986,17 @@ void generatePawnMoves(const Board &board, Movelist &moves, Bitboard pin_d, Bitb
 
         while (promo_left) {
             const auto index = builtin::poplsb(promo_left);
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_RIGHT, index, PieceType::QUEEN));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_RIGHT, index, PieceType::ROOK));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_RIGHT, index, PieceType::BISHOP));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_RIGHT, index, PieceType::KNIGHT));
+            if (!addPromotions(visit, index + DOWN_RIGHT, index)) return false;
         }
 
         while (promo_right) {
             const auto index = builtin::poplsb(promo_right);
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_LEFT, index, PieceType::QUEEN));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_LEFT, index, PieceType::ROOK));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_LEFT, index, PieceType::BISHOP));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN_LEFT, index, PieceType::KNIGHT));
+            if (!addPromotions(visit, index + DOWN_LEFT, index)) return false;
         }
 
         while (promo_push) {
             const auto index = builtin::poplsb(promo_push);
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN, index, PieceType::QUEEN));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN, index, PieceType::ROOK));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN, index, PieceType::BISHOP));
-            moves.add(Move::make<Move::PROMOTION>(index + DOWN, index, PieceType::KNIGHT));
+            if (!addPromotions(visit, index + DOWN, index)) return false;
         }
     }
 
@@ -2095,75 +3006,101 @@ void generatePawnMoves(const Board &board, Movelist &moves, Bitboard pin_d, Bitb
 
     while (mt != MoveGenType::QUIET && l_pawns) {
         const auto index = builtin::poplsb(l_pawns);
-        moves.add(Move::make<Move::NORMAL>(index + DOWN_RIGHT, index));
+        if (!visit(Move::make<Move::NORMAL>(index + DOWN_RIGHT, index))) return false;
     }
 
     while (mt != MoveGenType::QUIET && r_pawns) {
         const auto index = builtin::poplsb(r_pawns);
-        moves.add(Move::make<Move::NORMAL>(index + DOWN_LEFT, index));
+        if (!visit(Move::make<Move::NORMAL>(index + DOWN_LEFT, index))) return false;
     }
 
     while (mt != MoveGenType::CAPTURE && single_push) {
         const auto index = builtin::poplsb(single_push);
-        moves.add(Move::make<Move::NORMAL>(index + DOWN, index));
+        if (!visit(Move::make<Move::NORMAL>(index + DOWN, index))) return false;
     }
 
     while (mt != MoveGenType::CAPTURE && double_push) {
         const auto index = builtin::poplsb(double_push);
-        moves.add(Move::make<Move::NORMAL>(index + DOWN + DOWN, index));
+        if (!visit(Move::make<Move::NORMAL>(index + DOWN + DOWN, index))) return false;
     }
 
-    const Square ep = board.enpassantSq();
-    if (mt != MoveGenType::QUIET && ep != NO_SQ) {
-        const Square epPawn = ep + DOWN;
+    if (mt != MoveGenType::QUIET && board.enpassantSq() != NO_SQ) {
+        Bitboard epBB = enpassantMoves<c>(board, pawns_lr, pin_d, checkmask);
 
-        const Bitboard ep_mask = (1ull << epPawn) | (1ull << ep);
+        CHESS_STAT(stats::local().enpassant_attempts++);
+        CHESS_STAT(stats::local().enpassant_moves += builtin::popcount(epBB));
 
-        /*
-         In case the en passant square and the enemy pawn
-         that just moved are not on the checkmask
-         en passant is not available.
-        */
-        if ((checkmask & ep_mask) == 0) return;
+        while (epBB) {
+            const Square from = builtin::poplsb(epBB);
+            if (!visit(Move::make<Move::ENPASSANT>(from, board.enpassantSq()))) return false;
+        }
+    }
 
-        const Square kSQ = board.kingSq(c);
-        const Bitboard kingMask =
-            (1ull << kSQ) & MASK_RANK[static_cast<int>(utils::squareRank(epPawn))];
-        const Bitboard enemyQueenRook =
-            board.pieces(PieceType::ROOK, ~c) | board.pieces(PieceType::QUEEN, ~c);
+    return true;
+}
 
-        const bool isPossiblePin = kingMask && enemyQueenRook;
-        Bitboard epBB = attacks::pawn(~c, ep) & pawns_lr;
+/// @brief Counts the legal pawn moves, uses the same masks as generatePawnMoves.
+template <Color c, MoveGenType mt>
+[[nodiscard]] int countPawnMoves(const Board &board, Bitboard pin_d, Bitboard pin_hv,
+                                 Bitboard checkmask, Bitboard occ_enemy) {
+    const auto pawns = board.pieces(PieceType::PAWN, c);
 
-        // For one en passant square two pawns could potentially take there.
+    constexpr Direction UP = c == Color::WHITE ? Direction::NORTH : Direction::SOUTH;
 
-        while (epBB) {
-            const Square from = builtin::poplsb(epBB);
-            const Square to = ep;
-
-            /*
-             If the pawn is pinned but the en passant square is not on the
-             pin mask then the move is illegal.
-            */
-            if ((1ULL << from) & pin_d && !(pin_d & (1ull << ep))) continue;
-
-            const Bitboard connectingPawns = (1ull << epPawn) | (1ull << from);
-
-            /*
-             7k/4p3/8/2KP3r/8/8/8/8 b - - 0 1
-             If e7e5 there will be a potential ep square for us on e6.
-             However, we cannot take en passant because that would put our king
-             in check. For this scenario we check if there's an enemy rook/queen
-             that would give check if the two pawns were removed.
-             If that's the case then the move is illegal and we can break immediately.
-            */
-            if (isPossiblePin &&
-                (attacks::rook(kSQ, board.occ() & ~connectingPawns) & enemyQueenRook) != 0)
-                break;
+    constexpr Bitboard RANK_PROMO = c == Color::WHITE ? MASK_RANK[static_cast<int>(Rank::RANK_8)]
+                                                      : MASK_RANK[static_cast<int>(Rank::RANK_1)];
+    constexpr Bitboard DOUBLE_PUSH_RANK = c == Color::WHITE
+                                              ? MASK_RANK[static_cast<int>(Rank::RANK_3)]
+                                              : MASK_RANK[static_cast<int>(Rank::RANK_6)];
 
-            moves.add(Move::make<Move::ENPASSANT>(from, to));
-        }
+    const Bitboard pawns_lr = pawns & ~pin_hv;
+
+    const Bitboard unpinnedpawns_lr = pawns_lr & ~pin_d;
+    const Bitboard pinnedpawns_lr = pawns_lr & pin_d;
+
+    const Bitboard l_pawns =
+        ((pawnLeftAttacks<c>(unpinnedpawns_lr)) | (pawnLeftAttacks<c>(pinnedpawns_lr) & pin_d)) &
+        occ_enemy & checkmask;
+
+    const Bitboard r_pawns =
+        ((pawnRightAttacks<c>(unpinnedpawns_lr)) | (pawnRightAttacks<c>(pinnedpawns_lr) & pin_d)) &
+        occ_enemy & checkmask;
+
+    const Bitboard pawns_hv = pawns & ~pin_d;
+
+    const Bitboard pawns_pinned_hv = pawns_hv & pin_hv;
+    const Bitboard pawns_unpinned_hv = pawns_hv & ~pin_hv;
+
+    const Bitboard single_push_unpinned = shift<UP>(pawns_unpinned_hv) & ~board.occ();
+    const Bitboard single_push_pinned = shift<UP>(pawns_pinned_hv) & pin_hv & ~board.occ();
+
+    const Bitboard single_push = (single_push_unpinned | single_push_pinned) & checkmask;
+
+    const Bitboard double_push =
+        ((shift<UP>(single_push_unpinned & DOUBLE_PUSH_RANK) & ~board.occ()) |
+         (shift<UP>(single_push_pinned & DOUBLE_PUSH_RANK) & ~board.occ())) &
+        checkmask;
+
+    int count = 0;
+
+    if (mt != MoveGenType::QUIET) {
+        // every promotion square yields four moves
+        count += 4 * (builtin::popcount(l_pawns & RANK_PROMO) +
+                      builtin::popcount(r_pawns & RANK_PROMO) +
+                      builtin::popcount(single_push & RANK_PROMO));
+
+        count +=
+            builtin::popcount(l_pawns & ~RANK_PROMO) + builtin::popcount(r_pawns & ~RANK_PROMO);
+
+        if (board.enpassantSq() != NO_SQ)
+            count += builtin::popcount(enpassantMoves<c>(board, pawns_lr, pin_d, checkmask));
+    }
+
+    if (mt != MoveGenType::CAPTURE) {
+        count += builtin::popcount(single_push & ~RANK_PROMO) + builtin::popcount(double_push);
     }
+
+    return count;
 }
 
 [[nodiscard]] inline Bitboard generateKnightMoves(Square sq, Bitboard movable) {
@@ -2205,12 +3142,36 @@ void generatePawnMoves(const Board &board, Movelist &moves, Bitboard pin_d, Bitb
     return attacks::king(sq) & movable_square & ~_seen;
 }
 
-template <Color c, MoveGenType mt>
+template <Color c, MoveGenType mt, bool chess960>
 [[nodiscard]] inline Bitboard generateCastleMoves(const Board &board, Square sq, Bitboard seen,
                                                   Bitboard pinHV) {
     if constexpr (mt == MoveGenType::CAPTURE) return 0ull;
     const auto rights = board.castlingRights();
 
+    // standard chess, the king and rooks start on fixed squares and the rook can't be pinned
+    if constexpr (!chess960) {
+        if (sq == utils::relativeSquare(c, Square::SQ_E1)) {
+            constexpr Bitboard KING_PATH = (1ull << utils::relativeSquare(c, Square::SQ_F1)) |
+                                           (1ull << utils::relativeSquare(c, Square::SQ_G1));
+            constexpr Bitboard QUEEN_PATH = (1ull << utils::relativeSquare(c, Square::SQ_C1)) |
+                                            (1ull << utils::relativeSquare(c, Square::SQ_D1));
+            constexpr Bitboard QUEEN_EMPTY =
+                QUEEN_PATH | (1ull << utils::relativeSquare(c, Square::SQ_B1));
+
+            Bitboard moves = 0ull;
+
+            if (rights.hasCastlingRight(c, CastleSide::KING_SIDE) &&
+                !((board.occ() | seen) & KING_PATH))
+                moves |= 1ull << utils::relativeSquare(c, Square::SQ_H1);
+
+            if (rights.hasCastlingRight(c, CastleSide::QUEEN_SIDE) &&
+                !(board.occ() & QUEEN_EMPTY) && !(seen & QUEEN_PATH))
+                moves |= 1ull << utils::relativeSquare(c, Square::SQ_A1);
+
+            return moves;
+        }
+    }
+
     Bitboard moves = 0ull;
 
     for (const auto side : {CastleSide::KING_SIDE, CastleSide::QUEEN_SIDE}) {
@@ -2242,155 +3203,1202 @@ template <Color c, MoveGenType mt>
     return moves;
 }
 
-// all legal moves for a position
-template <Color c, MoveGenType mt>
-void legalmoves(Movelist &movelist, const Board &board) {
-    /*
-     The size of the movelist might not
-     be 0! This is done on purpose since it enables
-     you to append new move types to any movelist.
-    */
-    auto king_sq = board.kingSq(c);
-
-    int _doubleCheck = 0;
-
-    Bitboard _occ_us = board.us(c);
-    Bitboard _occ_enemy = board.us(~c);
-    Bitboard _occ_all = _occ_us | _occ_enemy;
-    Bitboard _enemy_emptyBB = ~_occ_us;
-
-    Bitboard _seen = seenSquares<~c>(board, _enemy_emptyBB);
-    Bitboard _checkMask = checkMask<c>(board, king_sq, _doubleCheck);
-    Bitboard _pinHV = pinMaskRooks<c>(board, king_sq, _occ_enemy, _occ_us);
-    Bitboard _pinD = pinMaskBishops<c>(board, king_sq, _occ_enemy, _occ_us);
-
-    assert(_doubleCheck <= 2);
+/*
+ Non king moves out of a single check. Only capturing the checker or stepping
+ between it and the king helps, so instead of walking all our pieces we walk
+ these few target squares and look up which pieces reach them. A pinned piece
+ can never resolve a check, it would have to leave its pin ray.
+ */
+template <Color c, MoveGenType mt, typename F>
+[[nodiscard]] bool generateEvasions(F &visit, const Board &board, Square king_sq) {
+    constexpr Direction UP = c == Color::WHITE ? Direction::NORTH : Direction::SOUTH;
+    constexpr Direction DOWN = c == Color::WHITE ? Direction::SOUTH : Direction::NORTH;
 
-    // Moves have to be on the checkmask
-    Bitboard movable_square;
+    constexpr Bitboard RANK_PROMO = c == Color::WHITE ? MASK_RANK[static_cast<int>(Rank::RANK_8)]
+                                                      : MASK_RANK[static_cast<int>(Rank::RANK_1)];
+    constexpr Bitboard DOUBLE_PUSH_RANK = c == Color::WHITE
+                                              ? MASK_RANK[static_cast<int>(Rank::RANK_4)]
+                                              : MASK_RANK[static_cast<int>(Rank::RANK_5)];
 
-    // Slider, Knights and King moves can only go to enemy or empty squares.
-    if (mt == MoveGenType::ALL)
-        movable_square = _enemy_emptyBB;
-    else if (mt == MoveGenType::CAPTURE)
-        movable_square = _occ_enemy;
-    else  // QUIET moves
-        movable_square = ~_occ_all;
+    const Bitboard checker = board.checkers();
+    const Square checker_sq = builtin::lsb(checker);
+    const Bitboard block = SQUARES_BETWEEN_BB[king_sq][checker_sq];
+    const Bitboard occ_all = board.occ();
 
-    Bitboard moves = generateKingMoves(king_sq, _seen, movable_square);
+    const Bitboard free = board.us(c) & ~(board.pinHV() | board.pinD());
+    const Bitboard pawns = board.pieces(PieceType::PAWN, c) & free;
+    const Bitboard knights = board.pieces(PieceType::KNIGHT, c) & free;
+    const Bitboard queens = board.pieces(PieceType::QUEEN, c);
+    const Bitboard bishops = (board.pieces(PieceType::BISHOP, c) | queens) & free;
+    const Bitboard rooks = (board.pieces(PieceType::ROOK, c) | queens) & free;
 
-    movable_square &= _checkMask;
+    Bitboard targets = 0ull;
+    if (mt != MoveGenType::QUIET) targets |= checker;
+    if (mt != MoveGenType::CAPTURE) targets |= block;
 
-    while (moves) {
-        Square to = builtin::poplsb(moves);
-        movelist.add(Move::make<Move::NORMAL>(king_sq, to));
-    }
+    while (targets) {
+        const Square to = builtin::poplsb(targets);
 
-    if (utils::squareRank(king_sq) == (c == Color::WHITE ? Rank::RANK_1 : Rank::RANK_8) &&
-        (board.castlingRights().hasCastlingRight(c) && _checkMask == DEFAULT_CHECKMASK)) {
-        moves = generateCastleMoves<c, mt>(board, king_sq, _seen, _pinHV);
+        Bitboard from = (attacks::knight(to) & knights) | (attacks::bishop(to, occ_all) & bishops) |
+                        (attacks::rook(to, occ_all) & rooks);
 
-        while (moves) {
-            Square to = builtin::poplsb(moves);
-            movelist.add(Move::make<Move::CASTLING>(king_sq, to));
+        while (from) {
+            if (!visit(Move::make<Move::NORMAL>(builtin::poplsb(from), to))) return false;
         }
     }
 
-    // Early return for double check as described earlier
-    if (_doubleCheck == 2) return;
-
-    // Prune knights that are pinned since these cannot move.
-    Bitboard knights_mask = board.pieces(PieceType::KNIGHT, c) & ~(_pinD | _pinHV);
-
-    // Prune horizontally pinned bishops
-    Bitboard bishops_mask = board.pieces(PieceType::BISHOP, c) & ~_pinHV;
+    if (mt != MoveGenType::QUIET) {
+        Bitboard from = attacks::pawn(~c, checker_sq) & pawns;
 
-    //  Prune diagonally pinned rooks
-    Bitboard rooks_mask = board.pieces(PieceType::ROOK, c) & ~_pinD;
+        while (from) {
+            const Square sq = builtin::poplsb(from);
 
-    // Prune double pinned queens
-    Bitboard queens_mask = board.pieces(PieceType::QUEEN, c) & ~(_pinD & _pinHV);
+            if (checker & RANK_PROMO) {
+                if (!addPromotions(visit, sq, checker_sq)) return false;
+            } else if (!visit(Move::make<Move::NORMAL>(sq, checker_sq))) {
+                return false;
+            }
+        }
 
-    // Add the moves to the movelist.
-    generatePawnMoves<c, mt>(board, movelist, _pinD, _pinHV, _checkMask, _occ_enemy);
+        if (board.enpassantSq() != NO_SQ) {
+            Bitboard ep = enpassantMoves<c>(board, pawns, 0ull, checker | block);
 
-    while (knights_mask) {
-        const Square from = builtin::poplsb(knights_mask);
-        moves = generateKnightMoves(from, movable_square);
-        while (moves) {
-            const Square to = builtin::poplsb(moves);
-            movelist.add(Move::make<Move::NORMAL>(from, to));
+            while (ep) {
+                const Square from = builtin::poplsb(ep);
+                if (!visit(Move::make<Move::ENPASSANT>(from, board.enpassantSq()))) return false;
+            }
         }
     }
 
-    while (bishops_mask) {
-        const Square from = builtin::poplsb(bishops_mask);
-        moves = generateBishopMoves(from, movable_square, _pinD, _occ_all);
-        while (moves) {
-            const Square to = builtin::poplsb(moves);
-            movelist.add(Move::make<Move::NORMAL>(from, to));
-        }
+    // pawn pushes onto the blocking squares, promotions count as captures like in
+    // generatePawnMoves
+    Bitboard single_push = shift<DOWN>(block) & pawns;
+    Bitboard promo_push = single_push & shift<DOWN>(RANK_PROMO);
+    Bitboard double_push = shift<DOWN>(shift<DOWN>(block & DOUBLE_PUSH_RANK) & ~occ_all) & pawns;
+
+    single_push &= ~promo_push;
+
+    while (mt != MoveGenType::QUIET && promo_push) {
+        const Square from = builtin::poplsb(promo_push);
+        if (!addPromotions(visit, from, from + UP)) return false;
     }
 
-    while (rooks_mask) {
-        const Square from = builtin::poplsb(rooks_mask);
-        moves = generateRookMoves(from, movable_square, _pinHV, _occ_all);
-        while (moves) {
-            const Square to = builtin::poplsb(moves);
-            movelist.add(Move::make<Move::NORMAL>(from, to));
-        }
+    while (mt != MoveGenType::CAPTURE && single_push) {
+        const Square from = builtin::poplsb(single_push);
+        if (!visit(Move::make<Move::NORMAL>(from, from + UP))) return false;
     }
 
-    while (queens_mask) {
-        const Square from = builtin::poplsb(queens_mask);
-        moves = generateQueenMoves(from, movable_square, _pinD, _pinHV, _occ_all);
-        while (moves) {
-            const Square to = builtin::poplsb(moves);
-            movelist.add(Move::make<Move::NORMAL>(from, to));
-        }
+    while (mt != MoveGenType::CAPTURE && double_push) {
+        const Square from = builtin::poplsb(double_push);
+        if (!visit(Move::make<Move::NORMAL>(from, from + UP + UP))) return false;
     }
+
+    return true;
 }
 
-template <MoveGenType mt>
-inline void legalmoves(Movelist &movelist, const Board &board) {
-    movelist.clear();
+template <Color c, MoveGenType mt, bool chess960, typename F>
+bool legalmoves(const Board &board, F &visit);
 
-    if (board.sideToMove() == Color::WHITE)
-        legalmoves<Color::WHITE, mt>(movelist, board);
-    else
-        legalmoves<Color::BLACK, mt>(movelist, board);
+/// @brief Whether the move from a discoverer stays on the ray to the enemy king.
+[[nodiscard]] inline bool staysOnRay(Square king_sq, Square from, Square to) {
+    return (SQUARES_BETWEEN_BB[king_sq][to] & (1ULL << from)) ||
+           (SQUARES_BETWEEN_BB[king_sq][from] & (1ULL << to));
 }
 
-}  // namespace movegen
-
-namespace uci {
+/// @brief Visits the moves of a piece which give check, directly or by leaving its ray.
+template <typename F>
+[[nodiscard]] bool addChecks(F &visit, const Board &board, Square from, Bitboard moves,
+                             Bitboard check_squares) {
+    if (!(board.discoverers() & (1ULL << from))) moves &= check_squares;
 
-[[nodiscard]] inline std::string moveToUci(const Move &move, bool chess960 = false) {
-    std::stringstream ss;
+    const Square enemy_king_sq = board.kingSq(~board.sideToMove());
 
-    // Get the from and to squares
-    Square from_sq = move.from();
-    Square to_sq = move.to();
+    while (moves) {
+        const Square to = builtin::poplsb(moves);
 
-    // If the move is not a chess960 castling move and is a king moving more than one square,
-    // update the to square to be the correct square for a regular castling move
-    if (!chess960 && move.typeOf() == Move::CASTLING) {
-        to_sq = utils::fileRankSquare(to_sq > from_sq ? File::FILE_G : File::FILE_C,
-                                      utils::squareRank(from_sq));
+        if ((check_squares & (1ULL << to)) || !staysOnRay(enemy_king_sq, from, to)) {
+            if (!visit(Move::make<Move::NORMAL>(from, to))) return false;
+        }
     }
 
-    // Add the from and to squares to the string stream
-    ss << squareToString[from_sq];
-    ss << squareToString[to_sq];
+    return true;
+}
 
-    // If the move is a promotion, add the promoted piece to the string stream
-    if (move.typeOf() == Move::PROMOTION) {
-        ss << PieceTypeToChar[move.promotionType()];
+/*
+ Quiet moves which give check. A piece checks directly when it lands on one of
+ the check squares of its type, a discoverer checks when it leaves the ray between
+ our slider and the enemy king. Out of check the moves are masked with these squares
+ up front, in check the few quiet evasions are tested one by one.
+ */
+template <Color c, bool chess960, typename F>
+[[nodiscard]] bool generateQuietChecks(F &visit, const Board &board) {
+    if (board.checkers()) {
+        auto checks = [&](Move move) { return !board.givesCheck(move) || visit(move); };
+        return legalmoves<c, MoveGenType::QUIET, chess960>(board, checks);
     }
 
-    return ss.str();
-}
-
+    constexpr Direction UP = c == Color::WHITE ? Direction::NORTH : Direction::SOUTH;
+    constexpr Direction DOWN = c == Color::WHITE ? Direction::SOUTH : Direction::NORTH;
+
+    constexpr Bitboard RANK_PROMO = c == Color::WHITE ? MASK_RANK[static_cast<int>(Rank::RANK_8)]
+                                                      : MASK_RANK[static_cast<int>(Rank::RANK_1)];
+    constexpr Bitboard DOUBLE_PUSH_RANK = c == Color::WHITE
+                                              ? MASK_RANK[static_cast<int>(Rank::RANK_3)]
+                                              : MASK_RANK[static_cast<int>(Rank::RANK_6)];
+
+    const Square king_sq = board.kingSq(c);
+    const Square enemy_king_sq = board.kingSq(~c);
+
+    const Bitboard occ_all = board.occ();
+    const Bitboard empty = ~occ_all;
+    const Bitboard pin_hv = board.pinHV();
+    const Bitboard pin_d = board.pinD();
+    const Bitboard discoverers = board.discoverers();
+
+    // pawn pushes, a discoverer always leaves its ray unless it stands on the king file
+    const Bitboard pawns = board.pieces(PieceType::PAWN, c) & ~pin_d;
+    const Bitboard pawn_discoverers =
+        pawns & discoverers & ~MASK_FILE[static_cast<int>(utils::squareFile(enemy_king_sq))];
+
+    const Bitboard single_push_unpinned = shift<UP>(pawns & ~pin_hv) & empty;
+    const Bitboard single_push_pinned = shift<UP>(pawns & pin_hv) & pin_hv & empty;
+    const Bitboard single_push = single_push_unpinned | single_push_pinned;
+
+    Bitboard double_push = shift<UP>(single_push & DOUBLE_PUSH_RANK) & empty;
+    Bitboard single_checks = single_push & ~RANK_PROMO;
+
+    single_checks &= board.checkSquares(PieceType::PAWN) | shift<UP>(pawn_discoverers);
+    double_push &= board.checkSquares(PieceType::PAWN) | shift<UP>(shift<UP>(pawn_discoverers));
+
+    while (single_checks) {
+        const Square to = builtin::poplsb(single_checks);
+        if (!visit(Move::make<Move::NORMAL>(to + DOWN, to))) return false;
+    }
+
+    while (double_push) {
+        const Square to = builtin::poplsb(double_push);
+        if (!visit(Move::make<Move::NORMAL>(to + DOWN + DOWN, to))) return false;
+    }
+
+    Bitboard knights = board.pieces(PieceType::KNIGHT, c) & ~(pin_d | pin_hv);
+    Bitboard bishops = board.pieces(PieceType::BISHOP, c) & ~pin_hv;
+    Bitboard rooks = board.pieces(PieceType::ROOK, c) & ~pin_d;
+    Bitboard queens = board.pieces(PieceType::QUEEN, c) & ~(pin_d & pin_hv);
+
+    while (knights) {
+        const Square from = builtin::poplsb(knights);
+        if (!addChecks(visit, board, from, generateKnightMoves(from, empty),
+                       board.checkSquares(PieceType::KNIGHT)))
+            return false;
+    }
+
+    while (bishops) {
+        const Square from = builtin::poplsb(bishops);
+        if (!addChecks(visit, board, from, generateBishopMoves(from, empty, pin_d, occ_all),
+                       board.checkSquares(PieceType::BISHOP)))
+            return false;
+    }
+
+    while (rooks) {
+        const Square from = builtin::poplsb(rooks);
+        if (!addChecks(visit, board, from, generateRookMoves(from, empty, pin_hv, occ_all),
+                       board.checkSquares(PieceType::ROOK)))
+            return false;
+    }
+
+    while (queens) {
+        const Square from = builtin::poplsb(queens);
+        if (!addChecks(visit, board, from,
+                       generateQueenMoves(from, empty, pin_d, pin_hv, occ_all),
+                       board.checkSquares(PieceType::QUEEN)))
+            return false;
+    }
+
+    // the king only checks by discovery or by castling, both need the attacked squares
+    const bool can_castle =
+        utils::squareRank(king_sq) == (c == Color::WHITE ? Rank::RANK_1 : Rank::RANK_8) &&
+        board.castlingRights().hasCastlingRight(c);
+
+    if (!can_castle && !(discoverers & (1ULL << king_sq))) return true;
+
+    const Bitboard seen = seenSquares<~c, chess960>(board, ~board.us(c));
+
+    if ((discoverers & (1ULL << king_sq)) &&
+        !addChecks(visit, board, king_sq, generateKingMoves(king_sq, seen, empty), 0ULL))
+        return false;
+
+    if (can_castle) {
+        Bitboard moves =
+            generateCastleMoves<c, MoveGenType::QUIET, chess960>(board, king_sq, seen, pin_hv);
+
+        while (moves) {
+            const Move move = Move::make<Move::CASTLING>(king_sq, builtin::poplsb(moves));
+            if (board.givesCheck(move) && !visit(move)) return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ Pseudo legal moves, neither pins nor attacks on the king squares are looked at,
+ Board::isLegalAfterPseudo sorts these out once a move is actually tried. In check
+ the other pieces are still limited to the check mask and in double check only
+ the king moves. Castling is only checked for its path and rights here.
+ */
+template <Color c, MoveGenType mt, bool chess960, typename F>
+[[nodiscard]] bool generatePseudoMoves(F &visit, const Board &board) {
+    constexpr MoveGenType legal_mt =
+        mt == MoveGenType::PSEUDO_CAPTURE ? MoveGenType::CAPTURE : MoveGenType::ALL;
+
+    const Square king_sq = board.kingSq(c);
+    const Bitboard checkers = board.checkers();
+
+    const Bitboard occ_us = board.us(c);
+    const Bitboard occ_enemy = board.us(~c);
+    const Bitboard occ_all = occ_us | occ_enemy;
+    const Bitboard movable_square = legal_mt == MoveGenType::ALL ? ~occ_us : occ_enemy;
+
+    Bitboard moves = attacks::king(king_sq) & movable_square;
+
+    while (moves) {
+        if (!visit(Move::make<Move::NORMAL>(king_sq, builtin::poplsb(moves)))) return false;
+    }
+
+    if (builtin::popcount(checkers) > 1) return true;
+
+    const Bitboard checkmask = checkMask(king_sq, checkers);
+
+    if (legal_mt == MoveGenType::ALL && !checkers &&
+        utils::squareRank(king_sq) == (c == Color::WHITE ? Rank::RANK_1 : Rank::RANK_8) &&
+        board.castlingRights().hasCastlingRight(c)) {
+        moves = generateCastleMoves<c, legal_mt, chess960>(board, king_sq, 0ULL, board.pinHV());
+
+        while (moves) {
+            if (!visit(Move::make<Move::CASTLING>(king_sq, builtin::poplsb(moves)))) return false;
+        }
+    }
+
+    if (!generatePawnMoves<c, legal_mt>(board, visit, 0ULL, 0ULL, checkmask, occ_enemy))
+        return false;
+
+    const Bitboard movable = movable_square & checkmask;
+
+    Bitboard knights = board.pieces(PieceType::KNIGHT, c);
+    Bitboard bishops = board.pieces(PieceType::BISHOP, c);
+    Bitboard rooks = board.pieces(PieceType::ROOK, c);
+    Bitboard queens = board.pieces(PieceType::QUEEN, c);
+
+    const auto visitAll = [&visit](Square from, Bitboard targets) {
+        while (targets) {
+            if (!visit(Move::make<Move::NORMAL>(from, builtin::poplsb(targets)))) return false;
+        }
+        return true;
+    };
+
+    while (knights) {
+        const Square from = builtin::poplsb(knights);
+        if (!visitAll(from, generateKnightMoves(from, movable))) return false;
+    }
+
+    while (bishops) {
+        const Square from = builtin::poplsb(bishops);
+        if (!visitAll(from, generateBishopMoves(from, movable, 0ULL, occ_all))) return false;
+    }
+
+    while (rooks) {
+        const Square from = builtin::poplsb(rooks);
+        if (!visitAll(from, generateRookMoves(from, movable, 0ULL, occ_all))) return false;
+    }
+
+    while (queens) {
+        const Square from = builtin::poplsb(queens);
+        if (!visitAll(from, generateQueenMoves(from, movable, 0ULL, 0ULL, occ_all))) return false;
+    }
+
+    return true;
+}
+
+// all legal moves for a position, visit returns false to stop the generation
+template <Color c, MoveGenType mt, bool chess960, typename F>
+bool legalmoves(const Board &board, F &visit) {
+    if constexpr (mt == MoveGenType::PSEUDO_ALL || mt == MoveGenType::PSEUDO_CAPTURE) {
+        return generatePseudoMoves<c, mt, chess960>(visit, board);
+    }
+
+    if constexpr (mt == MoveGenType::CHECKS || mt == MoveGenType::CAPTURES_AND_CHECKS) {
+        if constexpr (mt == MoveGenType::CAPTURES_AND_CHECKS) {
+            if (!legalmoves<c, MoveGenType::CAPTURE, chess960>(board, visit)) return false;
+        }
+
+        return generateQuietChecks<c, chess960>(visit, board);
+    }
+
+    auto king_sq = board.kingSq(c);
+
+    int _doubleCheck = builtin::popcount(board.checkers());
+
+    Bitboard _occ_us = board.us(c);
+    Bitboard _occ_enemy = board.us(~c);
+    Bitboard _occ_all = _occ_us | _occ_enemy;
+    Bitboard _enemy_emptyBB = ~_occ_us;
+
+    Bitboard _seen = seenSquares<~c, chess960>(board, _enemy_emptyBB);
+    Bitboard _pinHV = board.pinHV();
+    Bitboard _pinD = board.pinD();
+
+    assert(_doubleCheck <= 2);
+
+    CHESS_STAT(stats::local().checks[_doubleCheck]++);
+
+    Bitboard movable_square;
+
+    // Slider, Knights and King moves can only go to enemy or empty squares.
+    if (mt == MoveGenType::ALL)
+        movable_square = _enemy_emptyBB;
+    else if (mt == MoveGenType::CAPTURE)
+        movable_square = _occ_enemy;
+    else  // QUIET moves
+        movable_square = ~_occ_all;
+
+    Bitboard moves = generateKingMoves(king_sq, _seen, movable_square);
+
+    while (moves) {
+        Square to = builtin::poplsb(moves);
+        if (!visit(Move::make<Move::NORMAL>(king_sq, to))) return false;
+    }
+
+    // In check only evasions are legal, in double check only king moves
+    if (_doubleCheck) {
+        return _doubleCheck == 1 ? generateEvasions<c, mt>(visit, board, king_sq) : true;
+    }
+
+    if (utils::squareRank(king_sq) == (c == Color::WHITE ? Rank::RANK_1 : Rank::RANK_8) &&
+        board.castlingRights().hasCastlingRight(c)) {
+        moves = generateCastleMoves<c, mt, chess960>(board, king_sq, _seen, _pinHV);
+
+        while (moves) {
+            Square to = builtin::poplsb(moves);
+            if (!visit(Move::make<Move::CASTLING>(king_sq, to))) return false;
+        }
+    }
+
+    // Prune knights that are pinned since these cannot move.
+    Bitboard knights_mask = board.pieces(PieceType::KNIGHT, c) & ~(_pinD | _pinHV);
+
+    // Prune horizontally pinned bishops
+    Bitboard bishops_mask = board.pieces(PieceType::BISHOP, c) & ~_pinHV;
+
+    //  Prune diagonally pinned rooks
+    Bitboard rooks_mask = board.pieces(PieceType::ROOK, c) & ~_pinD;
+
+    // Prune double pinned queens
+    Bitboard queens_mask = board.pieces(PieceType::QUEEN, c) & ~(_pinD & _pinHV);
+
+    if (!generatePawnMoves<c, mt>(board, visit, _pinD, _pinHV, DEFAULT_CHECKMASK, _occ_enemy))
+        return false;
+
+    while (knights_mask) {
+        const Square from = builtin::poplsb(knights_mask);
+        moves = generateKnightMoves(from, movable_square);
+        while (moves) {
+            const Square to = builtin::poplsb(moves);
+            if (!visit(Move::make<Move::NORMAL>(from, to))) return false;
+        }
+    }
+
+    while (bishops_mask) {
+        const Square from = builtin::poplsb(bishops_mask);
+        moves = generateBishopMoves(from, movable_square, _pinD, _occ_all);
+        while (moves) {
+            const Square to = builtin::poplsb(moves);
+            if (!visit(Move::make<Move::NORMAL>(from, to))) return false;
+        }
+    }
+
+    while (rooks_mask) {
+        const Square from = builtin::poplsb(rooks_mask);
+        moves = generateRookMoves(from, movable_square, _pinHV, _occ_all);
+        while (moves) {
+            const Square to = builtin::poplsb(moves);
+            if (!visit(Move::make<Move::NORMAL>(from, to))) return false;
+        }
+    }
+
+    while (queens_mask) {
+        const Square from = builtin::poplsb(queens_mask);
+        moves = generateQueenMoves(from, movable_square, _pinD, _pinHV, _occ_all);
+        while (moves) {
+            const Square to = builtin::poplsb(moves);
+            if (!visit(Move::make<Move::NORMAL>(from, to))) return false;
+        }
+    }
+
+    return true;
+}
+
+template <Color c, MoveGenType mt, bool chess960>
+void legalmoves(Movelist &movelist, const Board &board) {
+    /*
+     The size of the movelist might not
+     be 0! This is done on purpose since it enables
+     you to append new move types to any movelist.
+    */
+    auto add = [&movelist](Move move) {
+        movelist.add(move);
+        return true;
+    };
+
+    legalmoves<c, mt, chess960>(board, add);
+}
+
+template <MoveGenType mt>
+inline void legalmoves(Movelist &movelist, const Board &board) {
+    movelist.clear();
+
+    // resolve the side and the variant once, the generators are specialised on both
+    if (board.chess960()) {
+        if (board.sideToMove() == Color::WHITE)
+            legalmoves<Color::WHITE, mt, true>(movelist, board);
+        else
+            legalmoves<Color::BLACK, mt, true>(movelist, board);
+    } else {
+        if (board.sideToMove() == Color::WHITE)
+            legalmoves<Color::WHITE, mt, false>(movelist, board);
+        else
+            legalmoves<Color::BLACK, mt, false>(movelist, board);
+    }
+
+    CHESS_STAT(stats::local().legalmoves++);
+    CHESS_STAT(stats::local().movelist_size[movelist.size()]++);
+}
+
+/*
+ Calls the visitor for every legal move straight from the generation loops,
+ without storing them. A visitor returning false stops the generation, one
+ returning void sees all moves. Returns false if the visitor stopped it.
+ */
+template <MoveGenType mt, typename F>
+inline bool legalmoves(const Board &board, F &&visitor) {
+    if constexpr (std::is_void_v<std::invoke_result_t<F &, Move>>) {
+        auto visit = [&visitor](Move move) {
+            visitor(move);
+            return true;
+        };
+
+        return legalmoves<mt>(board, visit);
+    } else {
+        const auto generate = [&board](auto &visit) {
+            if (board.chess960()) {
+                if (board.sideToMove() == Color::WHITE)
+                    return legalmoves<Color::WHITE, mt, true>(board, visit);
+                else
+                    return legalmoves<Color::BLACK, mt, true>(board, visit);
+            }
+
+            if (board.sideToMove() == Color::WHITE)
+                return legalmoves<Color::WHITE, mt, false>(board, visit);
+            else
+                return legalmoves<Color::BLACK, mt, false>(board, visit);
+        };
+
+#ifdef CHESS_STATS
+        int size = 0;
+        auto counted = [&visitor, &size](Move move) {
+            size++;
+            return bool(visitor(move));
+        };
+
+        const bool finished = generate(counted);
+
+        stats::local().legalmoves++;
+        // a stopped generation has not seen all moves, its size would skew the histogram
+        if (finished) stats::local().movelist_size[std::min(size, MAX_MOVES)]++;
+
+        return finished;
+#else
+        return generate(visitor);
+#endif
+    }
+}
+
+/*
+ Legal moves of one piece type landing on one square, castling excluded. The
+ candidates come from the attacks of the target square, like Board::attackersTo,
+ instead of walking all our pieces, and each one is checked with Board::isLegal.
+ */
+[[nodiscard]] inline Movelist movesTo(const Board &board, Square to, PieceType pt) {
+    Movelist moves;
+
+    const Color c = board.sideToMove();
+    const Bitboard to_bb = 1ULL << to;
+    const Bitboard occ = board.occ();
+    const Bitboard pieces = board.pieces(pt, c);
+
+    if (board.us(c) & to_bb) return moves;
+
+    const auto add = [&](Move move) {
+        if (board.isLegal(move)) moves.add(move);
+    };
+
+    Bitboard from = 0ULL;
+
+    switch (pt) {
+        case PieceType::PAWN: {
+            const auto down = [c](Bitboard b) { return c == Color::WHITE ? b >> 8 : b << 8; };
+            const Rank double_push_rank = c == Color::WHITE ? Rank::RANK_4 : Rank::RANK_5;
+
+            if (board.them(c) & to_bb) {
+                from = attacks::pawn(~c, to) & pieces;
+            } else {
+                from = down(to_bb) & pieces;
+
+                if (utils::squareRank(to) == double_push_rank && (down(to_bb) & ~occ))
+                    from |= down(down(to_bb)) & pieces;
+
+                if (to == board.enpassantSq()) {
+                    Bitboard ep = attacks::pawn(~c, to) & pieces;
+                    while (ep) add(Move::make<Move::ENPASSANT>(builtin::poplsb(ep), to));
+                }
+            }
+
+            const bool promotion =
+                utils::squareRank(to) == (c == Color::WHITE ? Rank::RANK_8 : Rank::RANK_1);
+
+            while (from) {
+                const Square sq = builtin::poplsb(from);
+
+                if (!promotion) {
+                    add(Move::make<Move::NORMAL>(sq, to));
+                } else {
+                    for (const auto promo : {PieceType::QUEEN, PieceType::ROOK, PieceType::BISHOP,
+                                             PieceType::KNIGHT})
+                        add(Move::make<Move::PROMOTION>(sq, to, promo));
+                }
+            }
+
+            return moves;
+        }
+        case PieceType::KNIGHT:
+            from = attacks::knight(to) & pieces;
+            break;
+        case PieceType::BISHOP:
+            from = attacks::bishop(to, occ) & pieces;
+            break;
+        case PieceType::ROOK:
+            from = attacks::rook(to, occ) & pieces;
+            break;
+        case PieceType::QUEEN:
+            from = attacks::queen(to, occ) & pieces;
+            break;
+        case PieceType::KING:
+            from = attacks::king(to) & pieces;
+            break;
+        default:
+            break;
+    }
+
+    while (from) add(Move::make<Move::NORMAL>(builtin::poplsb(from), to));
+
+    return moves;
+}
+
+/// @brief Whether the side to move has a legal move, stops at the first one found.
+[[nodiscard]] inline bool hasLegalMove(const Board &board) {
+    // the king moves come first, in most positions one of them is legal
+    return !legalmoves<MoveGenType::ALL>(board, [](Move) { return false; });
+}
+
+// number of legal moves for a position, without writing them to a movelist
+template <Color c, MoveGenType mt, bool chess960>
+[[nodiscard]] int countLegalMoves(const Board &board) {
+    if constexpr (mt == MoveGenType::CHECKS || mt == MoveGenType::CAPTURES_AND_CHECKS ||
+                  mt == MoveGenType::PSEUDO_ALL || mt == MoveGenType::PSEUDO_CAPTURE) {
+        int count = 0;
+        auto counter = [&count](Move) {
+            count++;
+            return true;
+        };
+
+        legalmoves<c, mt, chess960>(board, counter);
+        return count;
+    }
+
+    auto king_sq = board.kingSq(c);
+
+    int _doubleCheck = builtin::popcount(board.checkers());
+
+    Bitboard _occ_us = board.us(c);
+    Bitboard _occ_enemy = board.us(~c);
+    Bitboard _occ_all = _occ_us | _occ_enemy;
+    Bitboard _enemy_emptyBB = ~_occ_us;
+
+    Bitboard _seen = seenSquares<~c, chess960>(board, _enemy_emptyBB);
+    Bitboard _checkMask = checkMask(king_sq, board.checkers());
+    Bitboard _pinHV = board.pinHV();
+    Bitboard _pinD = board.pinD();
+
+    assert(_doubleCheck <= 2);
+
+    CHESS_STAT(stats::local().checks[_doubleCheck]++);
+
+    Bitboard movable_square;
+
+    if (mt == MoveGenType::ALL)
+        movable_square = _enemy_emptyBB;
+    else if (mt == MoveGenType::CAPTURE)
+        movable_square = _occ_enemy;
+    else  // QUIET moves
+        movable_square = ~_occ_all;
+
+    int count = builtin::popcount(generateKingMoves(king_sq, _seen, movable_square));
+
+    movable_square &= _checkMask;
+
+    if (utils::squareRank(king_sq) == (c == Color::WHITE ? Rank::RANK_1 : Rank::RANK_8) &&
+        (board.castlingRights().hasCastlingRight(c) && _checkMask == DEFAULT_CHECKMASK)) {
+        count += builtin::popcount(
+            generateCastleMoves<c, mt, chess960>(board, king_sq, _seen, _pinHV));
+    }
+
+    if (_doubleCheck == 2) return count;
+
+    Bitboard knights_mask = board.pieces(PieceType::KNIGHT, c) & ~(_pinD | _pinHV);
+    Bitboard bishops_mask = board.pieces(PieceType::BISHOP, c) & ~_pinHV;
+    Bitboard rooks_mask = board.pieces(PieceType::ROOK, c) & ~_pinD;
+    Bitboard queens_mask = board.pieces(PieceType::QUEEN, c) & ~(_pinD & _pinHV);
+
+    count += countPawnMoves<c, mt>(board, _pinD, _pinHV, _checkMask, _occ_enemy);
+
+    while (knights_mask) {
+        const Square from = builtin::poplsb(knights_mask);
+        count += builtin::popcount(generateKnightMoves(from, movable_square));
+    }
+
+    while (bishops_mask) {
+        const Square from = builtin::poplsb(bishops_mask);
+        count += builtin::popcount(generateBishopMoves(from, movable_square, _pinD, _occ_all));
+    }
+
+    while (rooks_mask) {
+        const Square from = builtin::poplsb(rooks_mask);
+        count += builtin::popcount(generateRookMoves(from, movable_square, _pinHV, _occ_all));
+    }
+
+    while (queens_mask) {
+        const Square from = builtin::poplsb(queens_mask);
+        count +=
+            builtin::popcount(generateQueenMoves(from, movable_square, _pinD, _pinHV, _occ_all));
+    }
+
+    return count;
+}
+
+template <MoveGenType mt = MoveGenType::ALL>
+[[nodiscard]] inline int countLegalMoves(const Board &board) {
+    int count;
+
+    if (board.chess960()) {
+        if (board.sideToMove() == Color::WHITE)
+            count = countLegalMoves<Color::WHITE, mt, true>(board);
+        else
+            count = countLegalMoves<Color::BLACK, mt, true>(board);
+    } else {
+        if (board.sideToMove() == Color::WHITE)
+            count = countLegalMoves<Color::WHITE, mt, false>(board);
+        else
+            count = countLegalMoves<Color::BLACK, mt, false>(board);
+    }
+
+    CHESS_STAT(stats::local().legalmoves++);
+    CHESS_STAT(stats::local().movelist_size[std::min(count, MAX_MOVES)]++);
+
+    return count;
+}
+
+}  // namespace movegen
+
+[[nodiscard]] inline bool Board::isPseudoLegal(const Move &move) const {
+    const Square from = move.from();
+    const Square to = move.to();
+    const Piece piece = at(from);
+    const Bitboard to_bb = 1ULL << to;
+
+    if (piece == Piece::NONE || color(piece) != side_to_move_) return false;
+
+    // only promotions carry a promotion piece
+    if (move.typeOf() != Move::PROMOTION && move.promotionType() != PieceType::KNIGHT)
+        return false;
+
+    const PieceType pt = utils::typeOfPiece(piece);
+    const Rank back_rank = side_to_move_ == Color::WHITE ? Rank::RANK_1 : Rank::RANK_8;
+
+    if (move.typeOf() == Move::CASTLING) {
+        if (pt != PieceType::KING || at(to) != utils::makePiece(side_to_move_, PieceType::ROOK))
+            return false;
+        if (utils::squareRank(from) != back_rank || utils::squareRank(to) != back_rank)
+            return false;
+
+        const auto side = to > from ? CastleSide::KING_SIDE : CastleSide::QUEEN_SIDE;
+
+        if (!castling_rights_.hasCastlingRight(side_to_move_, side) ||
+            castling_rights_.getRookFile(side_to_move_, side) != utils::squareFile(to))
+            return false;
+
+        const Square king_to = utils::relativeSquare(
+            side_to_move_, side == CastleSide::KING_SIDE ? Square::SQ_G1 : Square::SQ_C1);
+        const Square rook_to = utils::relativeSquare(
+            side_to_move_, side == CastleSide::KING_SIDE ? Square::SQ_F1 : Square::SQ_D1);
+
+        // everything between and below the king and rook, apart from themselves, is empty
+        const Bitboard path = movegen::SQUARES_BETWEEN_BB[from][to] |
+                              movegen::SQUARES_BETWEEN_BB[from][king_to] |
+                              movegen::SQUARES_BETWEEN_BB[to][rook_to] | (1ULL << king_to) |
+                              (1ULL << rook_to);
+
+        return (path & occ_all_ & ~((1ULL << from) | to_bb)) == 0ULL;
+    }
+
+    if (us(side_to_move_) & to_bb) return false;
+
+    if (pt == PieceType::PAWN) {
+        const Bitboard attacks = movegen::attacks::pawn(side_to_move_, from);
+
+        if (move.typeOf() == Move::ENPASSANT) return to == enpassant_sq_ && (attacks & to_bb);
+
+        const Rank promo_rank = side_to_move_ == Color::WHITE ? Rank::RANK_8 : Rank::RANK_1;
+        if ((move.typeOf() == Move::PROMOTION) != (utils::squareRank(to) == promo_rank))
+            return false;
+
+        if (attacks & to_bb) return them(side_to_move_) & to_bb;
+
+        const int push = side_to_move_ == Color::WHITE ? 8 : -8;
+        const Rank start_rank = side_to_move_ == Color::WHITE ? Rank::RANK_2 : Rank::RANK_7;
+
+        if (int(to) == int(from) + push) return !(occ_all_ & to_bb);
+
+        return int(to) == int(from) + 2 * push && utils::squareRank(from) == start_rank &&
+               !(occ_all_ & (to_bb | (1ULL << (int(from) + push))));
+    }
+
+    if (move.typeOf() != Move::NORMAL) return false;
+
+    switch (pt) {
+        case PieceType::KNIGHT:
+            return movegen::attacks::knight(from) & to_bb;
+        case PieceType::BISHOP:
+            return movegen::attacks::bishop(from, occ_all_) & to_bb;
+        case PieceType::ROOK:
+            return movegen::attacks::rook(from, occ_all_) & to_bb;
+        case PieceType::QUEEN:
+            return movegen::attacks::queen(from, occ_all_) & to_bb;
+        case PieceType::KING:
+            return movegen::attacks::king(from) & to_bb;
+        default:
+            return false;
+    }
+}
+
+[[nodiscard]] inline bool Board::isLegal(const Move &move) const {
+    if (!isPseudoLegal(move)) return false;
+
+    const Bitboard checkers = check_info_.checkers;
+    const Square king_sq = kingSq(side_to_move_);
+
+    // king moves and en passant are tested on the occupancy after the move, the
+    // pseudo generation only lets the other moves on the check mask through
+    if (checkers && move.from() != king_sq && move.typeOf() != Move::ENPASSANT) {
+        if (builtin::popcount(checkers) > 1) return false;
+        if (!(movegen::checkMask(king_sq, checkers) & (1ULL << move.to()))) return false;
+    }
+
+    return isLegalAfterPseudo(move);
+}
+
+[[nodiscard]] inline bool Board::isLegalAfterPseudo(const Move &move) const {
+    const Square from = move.from();
+    const Square to = move.to();
+    const Square king_sq = kingSq(side_to_move_);
+    const Color enemy = ~side_to_move_;
+
+    const Bitboard queens = pieces(PieceType::QUEEN, enemy);
+    const Bitboard bishops = pieces(PieceType::BISHOP, enemy) | queens;
+    const Bitboard rooks = pieces(PieceType::ROOK, enemy) | queens;
+
+    if (move.typeOf() == Move::CASTLING) {
+        if (check_info_.checkers) return false;
+
+        // same test as the generator, the chess960 variant also covers standard castling
+        const Bitboard enemy_empty = ~us(side_to_move_);
+        const Bitboard castles =
+            side_to_move_ == Color::WHITE
+                ? movegen::generateCastleMoves<Color::WHITE, MoveGenType::ALL, true>(
+                      *this, king_sq, movegen::seenSquares<Color::BLACK, true>(*this, enemy_empty),
+                      pinHV())
+                : movegen::generateCastleMoves<Color::BLACK, MoveGenType::ALL, true>(
+                      *this, king_sq, movegen::seenSquares<Color::WHITE, true>(*this, enemy_empty),
+                      pinHV());
+
+        return castles & (1ULL << to);
+    }
+
+    if (from == king_sq) {
+        // sliders see through the old king square
+        const Bitboard occ = occ_all_ ^ (1ULL << from);
+
+        return !((movegen::attacks::pawn(side_to_move_, to) & pieces(PieceType::PAWN, enemy)) |
+                 (movegen::attacks::knight(to) & pieces(PieceType::KNIGHT, enemy)) |
+                 (movegen::attacks::king(to) & pieces(PieceType::KING, enemy)) |
+                 (movegen::attacks::bishop(to, occ) & bishops) |
+                 (movegen::attacks::rook(to, occ) & rooks));
+    }
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        // two pawns leave their squares, test the king on the resulting occupancy
+        const Bitboard captured = 1ULL << (int(to) ^ 8);
+        const Bitboard occ = (occ_all_ ^ (1ULL << from) ^ captured) | (1ULL << to);
+
+        return !((movegen::attacks::pawn(side_to_move_, king_sq) &
+                  pieces(PieceType::PAWN, enemy) & ~captured) |
+                 (movegen::attacks::knight(king_sq) & pieces(PieceType::KNIGHT, enemy)) |
+                 (movegen::attacks::bishop(king_sq, occ) & bishops) |
+                 (movegen::attacks::rook(king_sq, occ) & rooks));
+    }
+
+    return !(pinned() & (1ULL << from)) || movegen::staysOnRay(king_sq, from, to);
+}
+
+[[nodiscard]] inline bool Board::givesCheck(const Move &move) const {
+    const Square from = move.from();
+    const Square to = move.to();
+    const Square enemy_king_sq = kingSq(~side_to_move_);
+    const Bitboard enemy_king = 1ULL << enemy_king_sq;
+
+    const Bitboard queens = pieces(PieceType::QUEEN, side_to_move_);
+    const Bitboard bishops = pieces(PieceType::BISHOP, side_to_move_) | queens;
+    const Bitboard rooks = pieces(PieceType::ROOK, side_to_move_) | queens;
+
+    if (move.typeOf() == Move::CASTLING) {
+        // king and rook both move, test our sliders on the resulting occupancy
+        const bool king_side = to > from;
+        const Square rook_to =
+            utils::relativeSquare(side_to_move_, king_side ? Square::SQ_F1 : Square::SQ_D1);
+        const Square king_to =
+            utils::relativeSquare(side_to_move_, king_side ? Square::SQ_G1 : Square::SQ_C1);
+
+        const Bitboard occ = (occ_all_ & ~((1ULL << from) | (1ULL << to))) | (1ULL << king_to) |
+                             (1ULL << rook_to);
+        const Bitboard rooks_after = (rooks & ~(1ULL << to)) | (1ULL << rook_to);
+
+        return (movegen::attacks::rook(enemy_king_sq, occ) & rooks_after) ||
+               (movegen::attacks::bishop(enemy_king_sq, occ) & bishops);
+    }
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        if (checkSquares(PieceType::PAWN) & (1ULL << to)) return true;
+
+        // the captured pawn may uncover a check as well as the capturing one
+        const Bitboard occ =
+            (occ_all_ ^ (1ULL << from) ^ (1ULL << (int(to) ^ 8))) | (1ULL << to);
+
+        return (movegen::attacks::rook(enemy_king_sq, occ) & rooks) ||
+               (movegen::attacks::bishop(enemy_king_sq, occ) & bishops);
+    }
+
+    if (move.typeOf() == Move::PROMOTION) {
+        // the promoted piece sees through the square the pawn left
+        const Bitboard occ = occ_all_ ^ (1ULL << from);
+
+        switch (move.promotionType()) {
+            case PieceType::KNIGHT:
+                if (movegen::attacks::knight(to) & enemy_king) return true;
+                break;
+            case PieceType::BISHOP:
+                if (movegen::attacks::bishop(to, occ) & enemy_king) return true;
+                break;
+            case PieceType::ROOK:
+                if (movegen::attacks::rook(to, occ) & enemy_king) return true;
+                break;
+            default:
+                if (movegen::attacks::queen(to, occ) & enemy_king) return true;
+                break;
+        }
+    } else if (checkSquares(at<PieceType>(from)) & (1ULL << to)) {
+        return true;
+    }
+
+    return (discoverers() & (1ULL << from)) &&
+           !movegen::staysOnRay(enemy_king_sq, from, to);
+}
+
+[[nodiscard]] inline U64 Board::keyAfter(const Move &move) const {
+    const Square from = move.from();
+    const Square to = move.to();
+    const Piece piece = at(from);
+    const Piece captured = at(to);
+
+    U64 key = hash_key_ ^ zobrist::sideToMove();
+
+    if (enpassant_sq_ != NO_SQ) key ^= zobrist::enpassant(utils::squareFile(enpassant_sq_));
+
+    const CastlingRights rights =
+        chess960_ ? castlingRightsAfter<true>(move) : castlingRightsAfter<false>(move);
+    key ^= zobrist::castling(castling_rights_.getHashIndex()) ^
+           zobrist::castling(rights.getHashIndex());
+
+    if (move.typeOf() == Move::CASTLING) {
+        const bool king_side = to > from;
+        const Square rook_to =
+            utils::relativeSquare(side_to_move_, king_side ? Square::SQ_F1 : Square::SQ_D1);
+        const Square king_to =
+            utils::relativeSquare(side_to_move_, king_side ? Square::SQ_G1 : Square::SQ_C1);
+
+        return key ^ zobrist::piece(piece, from) ^ zobrist::piece(piece, king_to) ^
+               zobrist::piece(captured, to) ^ zobrist::piece(captured, rook_to);
+    }
+
+    key ^= zobrist::piece(piece, from);
+
+    if (captured != Piece::NONE) key ^= zobrist::piece(captured, to);
+
+    if (move.typeOf() == Move::PROMOTION)
+        return key ^ zobrist::piece(utils::makePiece(side_to_move_, move.promotionType()), to);
+
+    key ^= zobrist::piece(piece, to);
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        return key ^ zobrist::piece(utils::makePiece(~side_to_move_, PieceType::PAWN),
+                                    Square(int(to) ^ 8));
+    }
+
+    // like makeMove, a double push only sets the en passant square if a pawn can capture
+    if (utils::typeOfPiece(piece) == PieceType::PAWN && std::abs(int(to) - int(from)) == 16) {
+        const Square ep = Square(int(to) ^ 8);
+
+        if (movegen::attacks::pawn(side_to_move_, ep) & pieces(PieceType::PAWN, ~side_to_move_))
+            key ^= zobrist::enpassant(utils::squareFile(ep));
+    }
+
+    return key;
+}
+
+/****************************************************************************\
+ * Move Picker                                                               *
+\****************************************************************************/
+
+/*
+ Returns the legal moves of a position one at a time for a search.
+ The hash move comes first, then the captures and promotions by MVV-LVA,
+ then the killers, the quiet moves by history score and last the captures
+ which lose material according to Board::see. Each stage
+ is generated only when the previous one is exhausted, so a node which
+ cuts off on a capture never generates its quiet moves. The check and pin
+ information is computed once by Board::makeMove and shared by all stages.
+ */
+class MovePicker {
+   public:
+    /// @brief History scores of quiet moves, indexed by color, from and to square.
+    using History = int16_t[2][MAX_SQ][MAX_SQ];
+
+    MovePicker(const Board &board, Move hash_move, Move killer1 = Move::NO_MOVE,
+               Move killer2 = Move::NO_MOVE, const History *history = nullptr)
+        : board_(board),
+          hash_move_(hash_move),
+          killers_{killer1, killer2 != killer1 ? killer2 : Move(Move::NO_MOVE)},
+          history_(history) {}
+
+    /// @brief Returns the next legal move or Move::NO_MOVE once all moves were returned.
+    [[nodiscard]] Move next();
+
+   private:
+    enum class Stage : uint8_t {
+        HASH,
+        GEN_CAPTURES,
+        CAPTURES,
+        KILLERS,
+        GEN_QUIETS,
+        QUIETS,
+        BAD_CAPTURES,
+        DONE
+    };
+
+    [[nodiscard]] bool isCaptureStage(Move move) const {
+        return move.typeOf() == Move::PROMOTION || move.typeOf() == Move::ENPASSANT ||
+               (move.typeOf() != Move::CASTLING && board_.at(move.to()) != Piece::NONE);
+    }
+
+    void generateCaptures();
+    void generateQuiets();
+
+    [[nodiscard]] Move pickBest(Movelist &moves, int &index, bool skip_killers);
+
+    const Board &board_;
+
+    Move hash_move_;
+    Move killers_[2];
+    const History *history_;
+
+    Movelist captures_;
+    Movelist quiets_;
+
+    int capture_index_ = 0;
+    int bad_capture_count_ = 0;
+    int bad_capture_index_ = 0;
+    int quiet_index_ = 0;
+    int killer_index_ = 0;
+
+    Stage stage_ = Stage::HASH;
+};
+
+inline void MovePicker::generateCaptures() {
+    movegen::legalmoves<MoveGenType::CAPTURE>(captures_, board_);
+
+    for (auto &move : captures_) {
+        const auto attacker = board_.at<PieceType>(move.from());
+        auto victim = board_.at<PieceType>(move.to());
+
+        if (move.typeOf() == Move::ENPASSANT) victim = PieceType::PAWN;
+
+        int score = 10 * PIECE_VALUE[static_cast<int>(victim)] -
+                    PIECE_VALUE[static_cast<int>(attacker)] / 10;
+
+        if (move.typeOf() == Move::PROMOTION)
+            score += 10 * PIECE_VALUE[static_cast<int>(move.promotionType())];
+
+        move.setScore(static_cast<int16_t>(score));
+    }
+}
+
+inline void MovePicker::generateQuiets() {
+    movegen::legalmoves<MoveGenType::QUIET>(quiets_, board_);
+
+    const auto color = static_cast<int>(board_.sideToMove());
+
+    for (auto &move : quiets_) {
+        move.setScore(history_ ? (*history_)[color][move.from()][move.to()] : 0);
+    }
+}
+
+/// @brief Selection sort step, moves which were already returned by an earlier stage are skipped.
+inline Move MovePicker::pickBest(Movelist &moves, int &index, bool skip_killers) {
+    while (index < moves.size()) {
+        int best = index;
+
+        for (int i = index + 1; i < moves.size(); i++) {
+            if (moves[i].score() > moves[best].score()) best = i;
+        }
+
+        std::swap(moves[index], moves[best]);
+
+        const Move move = moves[index++];
+
+        if (move == hash_move_) continue;
+        if (skip_killers && (move == killers_[0] || move == killers_[1])) continue;
+
+        return move;
+    }
+
+    return Move::NO_MOVE;
+}
+
+inline Move MovePicker::next() {
+    switch (stage_) {
+        case Stage::HASH:
+            stage_ = Stage::GEN_CAPTURES;
+
+            if (hash_move_ != Move::NO_MOVE && board_.isLegal(hash_move_)) return hash_move_;
+
+            hash_move_ = Move::NO_MOVE;
+            [[fallthrough]];
+
+        case Stage::GEN_CAPTURES:
+            generateCaptures();
+
+            stage_ = Stage::CAPTURES;
+            [[fallthrough]];
+
+        case Stage::CAPTURES:
+            while (true) {
+                const Move move = pickBest(captures_, capture_index_, false);
+                if (move == Move::NO_MOVE) break;
+
+                if (board_.see(move, 0)) return move;
+
+                // losing captures are tried after the quiet moves, the returned
+                // moves in front of capture_index_ make room for them
+                captures_[bad_capture_count_++] = move;
+            }
+
+            stage_ = Stage::KILLERS;
+            [[fallthrough]];
+
+        case Stage::KILLERS:
+            while (killer_index_ < 2) {
+                const Move killer = killers_[killer_index_++];
+
+                if (killer != Move::NO_MOVE && killer != hash_move_ && !isCaptureStage(killer) &&
+                    board_.isLegal(killer))
+                    return killer;
+            }
+
+            stage_ = Stage::GEN_QUIETS;
+            [[fallthrough]];
+
+        case Stage::GEN_QUIETS:
+            generateQuiets();
+
+            stage_ = Stage::QUIETS;
+            [[fallthrough]];
+
+        case Stage::QUIETS: {
+            const Move move = pickBest(quiets_, quiet_index_, true);
+            if (move != Move::NO_MOVE) return move;
+
+            stage_ = Stage::BAD_CAPTURES;
+            [[fallthrough]];
+        }
+
+        case Stage::BAD_CAPTURES:
+            if (bad_capture_index_ < bad_capture_count_) return captures_[bad_capture_index_++];
+
+            stage_ = Stage::DONE;
+            [[fallthrough]];
+
+        case Stage::DONE:
+            return Move::NO_MOVE;
+    }
+
+    return Move::NO_MOVE;
+}
+
+namespace uci {
+
+[[nodiscard]] inline std::string moveToUci(const Move &move, bool chess960 = false) {
+    std::stringstream ss;
+
+    // Get the from and to squares
+    Square from_sq = move.from();
+    Square to_sq = move.to();
+
+    // If the move is not a chess960 castling move and is a king moving more than one square,
+    // update the to square to be the correct square for a regular castling move
+    if (!chess960 && move.typeOf() == Move::CASTLING) {
+        to_sq = utils::fileRankSquare(to_sq > from_sq ? File::FILE_G : File::FILE_C,
+                                      utils::squareRank(from_sq));
+    }
+
+    // Add the from and to squares to the string stream
+    ss << squareToString[from_sq];
+    ss << squareToString[to_sq];
+
+    // If the move is a promotion, add the promoted piece to the string stream
+    if (move.typeOf() == Move::PROMOTION) {
+        ss << PieceTypeToChar[move.promotionType()];
+    }
+
+    return ss.str();
+}
+
 [[nodiscard]] inline Move uciToMove(const Board &board, const std::string &uci) {
     Square source = utils::extractSquare(uci.substr(0, 2));
     Square target = utils::extractSquare(uci.substr(2, 2));
@@ -2441,22 +4449,23 @@ namespace uci {
 
     if (pt != PieceType::PAWN) {
         san += repPieceType[int(pt)];
-    }
 
-    Movelist moves;
-    movegen::legalmoves(moves, board);
+        // other pieces of the same type reaching the square, the file is preferred,
+        // then the rank, both are needed if neither is unique among them
+        bool ambiguous = false, same_file = false, same_rank = false;
 
-    for (const auto &m : moves) {
-        if (pt != PieceType::PAWN && m != move && board.at(m.from()) == board.at(move.from()) &&
-            m.to() == move.to()) {
-            if (utils::squareFile(m.from()) == utils::squareFile(move.from())) {
-                san += std::to_string(int(utils::squareRank(move.from())) + 1);
-                break;
-            } else {
-                san += repFile[int(utils::squareFile(move.from()))];
-                break;
-            }
+        for (const auto &m : movegen::movesTo(board, move.to(), pt)) {
+            if (m == move) continue;
+
+            ambiguous = true;
+            same_file |= utils::squareFile(m.from()) == utils::squareFile(move.from());
+            same_rank |= utils::squareRank(m.from()) == utils::squareRank(move.from());
         }
+
+        if (ambiguous && (!same_file || same_rank))
+            san += repFile[int(utils::squareFile(move.from()))];
+        if (ambiguous && same_file)
+            san += std::to_string(int(utils::squareRank(move.from())) + 1);
     }
 
     if (board.at(move.to()) != Piece::NONE || move.typeOf() == Move::ENPASSANT) {
@@ -2478,7 +4487,7 @@ namespace uci {
     board.makeMove(move);
 
     if (board.inCheck()) {
-        if (board.isGameOver().second == GameResult::LOSE) {
+        if (!movegen::hasLegalMove(board)) {
             san += "#";
         } else {
             san += "+";
@@ -2528,7 +4537,7 @@ namespace uci {
     board.makeMove(move);
 
     if (board.inCheck()) {
-        if (board.isGameOver().second == GameResult::LOSE) {
+        if (!movegen::hasLegalMove(board)) {
             lan += "#";
         } else {
             lan += "+";
@@ -2539,23 +4548,30 @@ namespace uci {
 }
 
 [[nodiscard]] inline Move parseSan(const Board &board, std::string san) {
-    Movelist moves;
-    movegen::legalmoves(moves, board);
+    // the first legal move the predicate accepts, generation stops there
+    const auto find = [&board](auto &&predicate) {
+        Move found = Move::NO_MOVE;
+        movegen::legalmoves<MoveGenType::ALL>(board, [&](Move move) {
+            if (!predicate(move)) return true;
+            found = move;
+            return false;
+        });
+        return found;
+    };
+
     if (san == "0-0" || san == "0-0+" || san == "0-0#" || san == "O-O" || san == "O-O+" ||
         san == "O-O#") {
-        for (auto move : moves) {
-            if (move.typeOf() == Move::CASTLING && move.to() > move.from()) {
-                return move;
-            }
-        }
+        const Move move = find([](Move m) {
+            return m.typeOf() == Move::CASTLING && m.to() > m.from();
+        });
+        if (move != Move::NO_MOVE) return move;
         throw std::runtime_error("illegal san, step 1: " + san);
     } else if (san == "0-0-0" || san == "0-0-0+" || san == "0-0-0#" || san == "O-O-O" ||
                san == "O-O-O+" || san == "O-O-O#") {
-        for (auto move : moves) {
-            if (move.typeOf() == Move::CASTLING && move.to() < move.from()) {
-                return move;
-            }
-        }
+        const Move move = find([](Move m) {
+            return m.typeOf() == Move::CASTLING && m.to() < m.from();
+        });
+        if (move != Move::NO_MOVE) return move;
         throw std::runtime_error("illegal san, step 2: " + san);
     }
 
@@ -2567,8 +4583,12 @@ namespace uci {
     4     | ([a-h][1-8]) match to square, always present
     5     | (=?[nbrqkNBRQK])?[\\+#]? match promotion (optional), check + or checkmate #
     */
-    const auto match =
-        utils::regex(san, "^([NBKRQ])?([a-h])?([1-8])?[\\-x]?([a-h][1-8])(=?[nbrqkNBRQK])?[\\+#]?");
+    // compiled once, building the regex costs far more than the rest of the parsing
+    static const std::regex SAN_REGEX(
+        "^([NBKRQ])?([a-h])?([1-8])?[\\-x]?([a-h][1-8])(=?[nbrqkNBRQK])?[\\+#]?");
+
+    std::smatch match;
+    std::regex_search(san, match, SAN_REGEX);
 
     Square to = utils::extractSquare(match.str(4));
 
@@ -2586,39 +4606,30 @@ namespace uci {
         from_rank = Rank(match.str(3)[0] - '1');
     }
 
-    if (!match.str(1).empty()) {
-        moving = charToPieceType[match.str(1)[0]];
-    } else if (!match.str(2).empty() && !match.str(3).empty()) {
-        for (auto move : moves) {
-            if (move.from() == utils::fileRankSquare(from_file, from_rank) && move.to() == to &&
-                utils::typeOfPiece(board.at(move.from())) == moving) {
-                if (move.typeOf() == Move::PROMOTION) {
-                    if (move.promotionType() == promotionType)
-                        return move;
-                    else
-                        throw std::runtime_error("illegal san, step 3: " + san);
-                }
+    if (!match.str(1).empty()) moving = charToPieceType[match.str(1)[0]];
+
+    const Movelist moves = movegen::movesTo(board, to, moving);
+
+    if (match.str(1).empty() && !match.str(2).empty() && !match.str(3).empty()) {
+        bool from_found = false;
+
+        for (const auto move : moves) {
+            if (move.from() != utils::fileRankSquare(from_file, from_rank)) continue;
+            if (move.typeOf() != Move::PROMOTION || move.promotionType() == promotionType)
                 return move;
-            }
+            from_found = true;
         }
+
+        if (from_found) throw std::runtime_error("illegal san, step 3: " + san);
         throw std::runtime_error("illegal san, step 4: " + san);
     }
 
-    for (auto move : moves) {
-        if (utils::typeOfPiece(board.at(move.from())) == moving && to == move.to()) {
-            if (move.typeOf() == Move::PROMOTION) {
-                if (promotionType == move.promotionType()) {
-                    return move;
-                }
-            } else {
-                if (from_file == File::NO_FILE && from_rank == Rank::NO_RANK) {
-                    return move;
-                } else if ((utils::squareFile(move.from()) == from_file) ||
-                           (utils::squareRank(move.from()) == from_rank)) {
-                    return move;
-                }
-            }
-        }
+    for (const auto move : moves) {
+        if (from_file != File::NO_FILE && utils::squareFile(move.from()) != from_file) continue;
+        if (from_rank != Rank::NO_RANK && utils::squareRank(move.from()) != from_rank) continue;
+        if (move.typeOf() == Move::PROMOTION && move.promotionType() != promotionType) continue;
+
+        return move;
     }
 
     throw std::runtime_error("illegal san, step 5: " + san);
@@ -1,24 +1,209 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
+#include <map>
+#include <mutex>
 #include <sstream>
-#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "chess.hpp"
+#include "perf_counters.hpp"
 
 using namespace chess;
 
+// A subtree below the root, identified by the moves that lead to it.
+struct PerftTask {
+    std::vector<Move> line;
+};
+
+// Work-stealing deque. The owner pops from the back, thieves steal from the front.
+class WorkQueue {
+   public:
+    void push(PerftTask task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+
+    bool pop(PerftTask &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.back());
+        tasks_.pop_back();
+        return true;
+    }
+
+    bool steal(PerftTask &task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) return false;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return true;
+    }
+
+   private:
+    std::deque<PerftTask> tasks_;
+    std::mutex mutex_;
+};
+
+// Fixed size perft transposition table, safe to share between threads without locking.
+// Every entry stores the key xor'ed with the data, a torn write therefore fails the key check
+// on the next probe and is treated as a miss. Entries are keyed by the full hash and the
+// depth, so they stay valid across positions and runs, only resize() starts out empty.
+class PerftCache {
+   public:
+    void resize(std::size_t mb) {
+        std::size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= mb * 1024 * 1024) count *= 2;
+
+        table_ = mb ? std::vector<Entry>(count) : std::vector<Entry>();
+        mask_ = table_.empty() ? 0 : table_.size() - 1;
+    }
+
+    bool enabled() const { return !table_.empty(); }
+
+    bool probe(U64 hash, int depth, uint64_t &nodes) const {
+        const auto &entry = table_[hash & mask_];
+        const uint64_t data = entry.data.load(std::memory_order_relaxed);
+        const uint64_t key = entry.key.load(std::memory_order_relaxed);
+
+        if ((key ^ data) != hash || (data & DEPTH_MASK) != uint64_t(depth)) return false;
+
+        nodes = data >> DEPTH_BITS;
+        return true;
+    }
+
+    void store(U64 hash, int depth, uint64_t nodes) {
+        auto &entry = table_[hash & mask_];
+        const uint64_t data = (nodes << DEPTH_BITS) | uint64_t(depth);
+
+        entry.key.store(hash ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+
+   private:
+    // the low bits hold the remaining depth, the rest the subtree node count
+    static constexpr int DEPTH_BITS = 8;
+    static constexpr uint64_t DEPTH_MASK = (1ull << DEPTH_BITS) - 1;
+
+    struct Entry {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> data{0};
+    };
+
+    std::vector<Entry> table_;
+    std::size_t mask_ = 0;
+};
+
+struct PerftCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Move categories of one ply, in the layout of the classic perft result tables.
+struct PerftStats {
+    uint64_t nodes = 0;
+    uint64_t captures = 0;
+    uint64_t enpassants = 0;
+    uint64_t castles = 0;
+    uint64_t promotions = 0;
+    uint64_t checks = 0;
+    uint64_t discoveredChecks = 0;
+    uint64_t doubleChecks = 0;
+    uint64_t checkmates = 0;
+};
+
+// Returns the pieces which would give check after the move, without making it.
+template <Color c>
+Bitboard checkersAfter(const Board &board, Move move) {
+    const Square from = move.from();
+    Square to = move.to();
+
+    Bitboard occ = board.occ() & ~(1ull << from);
+    Bitboard pieces[6];
+
+    for (PieceType pt = PieceType::PAWN; pt < PieceType::NONE; pt++) {
+        pieces[int(pt)] = board.pieces(pt, c);
+    }
+
+    PieceType moved = board.at<PieceType>(from);
+    pieces[int(moved)] &= ~(1ull << from);
+
+    if (move.typeOf() == Move::CASTLING) {
+        // only the rook can give check, the king might still uncover a slider
+        const bool kingSide = to > from;
+        const Square kingTo = utils::relativeSquare(c, kingSide ? SQ_G1 : SQ_C1);
+
+        pieces[int(PieceType::ROOK)] &= ~(1ull << to);
+        occ &= ~(1ull << to);
+        occ |= (1ull << kingTo);
+
+        moved = PieceType::ROOK;
+        to = utils::relativeSquare(c, kingSide ? SQ_F1 : SQ_D1);
+    } else if (move.typeOf() == Move::PROMOTION) {
+        moved = move.promotionType();
+    } else if (move.typeOf() == Move::ENPASSANT) {
+        occ &= ~(1ull << (to ^ 8));
+    }
+
+    pieces[int(moved)] |= (1ull << to);
+    occ |= (1ull << to);
+
+    const Square ksq = board.kingSq(~c);
+
+    const Bitboard queens = pieces[int(PieceType::QUEEN)];
+
+    return (movegen::attacks::pawn(~c, ksq) & pieces[int(PieceType::PAWN)]) |
+           (movegen::attacks::knight(ksq) & pieces[int(PieceType::KNIGHT)]) |
+           (movegen::attacks::bishop(ksq, occ) & (pieces[int(PieceType::BISHOP)] | queens)) |
+           (movegen::attacks::rook(ksq, occ) & (pieces[int(PieceType::ROOK)] | queens));
+}
+
+// Square the moving piece ends up on, for castling this is the square of the rook.
+Square destination(Color c, Move move) {
+    if (move.typeOf() != Move::CASTLING) return move.to();
+    return utils::relativeSquare(c, move.to() > move.from() ? SQ_F1 : SQ_D1);
+}
+
 class PerftTest {
    public:
     uint64_t nodes;
     Board board;
+    int threads = 1;
+    PerftCache cache;
+    // count the leaves with movegen::countLegalMoves instead of filling a movelist
+    bool bulk = true;
+    // hardware counters of the last run(), all zero if they are unavailable
+    PerfCounters counters;
+    PerfCounters::Reading reading;
+
+    uint64_t leafCount(const Board &b) const {
+        if (bulk) return movegen::countLegalMoves(b);
 
-    uint64_t perft(int depth, int max) {
         Movelist moves;
-        movegen::legalmoves(moves, board);
+        movegen::legalmoves(moves, b);
+        return moves.size();
+    }
 
+    uint64_t perft(int depth, int max) {
         if (depth == 1) {
-            return moves.size();
+            const auto count = leafCount(board);
+            // a depth 1 search has no children that could do the root bookkeeping
+            if (max == 1) nodes += count;
+            return count;
         }
 
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+
         U64 nodesIt = 0;
 
         for (int i = 0; i < moves.size(); i++) {
@@ -35,17 +220,271 @@ class PerftTest {
         return nodesIt;
     }
 
-    uint64_t testPositionPerft(Board &b, int depth, uint64_t expectedNodeCount) {
+    // Counts the nodes of a subtree without touching the root bookkeeping in perft().
+    uint64_t perftSubtree(Board &b, int depth, PerftCacheStats &stats) {
+        // probing depth 1 costs more than generating the moves
+        const bool useCache = cache.enabled() && depth > 1;
+
+        uint64_t nodesIt = 0;
+
+        if (useCache) {
+            if (cache.probe(b.hash(), depth, nodesIt)) {
+                stats.hits++;
+                return nodesIt;
+            }
+            stats.misses++;
+        }
+
+        if (depth <= 1) {
+            return depth == 1 ? leafCount(b) : 1;
+        }
+
+        Movelist moves;
+        movegen::legalmoves(moves, b);
+
+        for (const auto move : moves) {
+            b.makeMove(move);
+            nodesIt += perftSubtree(b, depth - 1, stats);
+            b.unmakeMove(move);
+        }
+
+        if (useCache) cache.store(b.hash(), depth, nodesIt);
+
+        return nodesIt;
+    }
+
+    // Collects every line of length `ply` from the current position as a task.
+    void splitTasks(Board &b, int ply, std::vector<Move> &line, std::vector<PerftTask> &tasks) {
+        if (ply == 0) {
+            tasks.push_back({line});
+            return;
+        }
+
+        Movelist moves;
+        movegen::legalmoves(moves, b);
+
+        for (const auto move : moves) {
+            line.push_back(move);
+            b.makeMove(move);
+            splitTasks(b, ply - 1, line, tasks);
+            b.unmakeMove(move);
+            line.pop_back();
+        }
+    }
+
+    uint64_t perftParallel(int depth, PerftCacheStats &stats) {
+        // Split two plies below the root, this gives a few hundred tasks for typical positions
+        // which is plenty for balancing the load across the workers.
+        const int split = std::min(depth - 1, 2);
+
+        if (threads <= 1 || split <= 0) {
+            return perftSubtree(board, depth, stats);
+        }
+
+        std::vector<PerftTask> tasks;
+        std::vector<Move> line;
+        splitTasks(board, split, line, tasks);
+
+        std::vector<WorkQueue> queues(threads);
+        for (std::size_t i = 0; i < tasks.size(); i++) {
+            queues[i % threads].push(std::move(tasks[i]));
+        }
+
+        std::atomic<uint64_t> total{0};
+        std::mutex statsMutex;
+
+        const auto worker = [&](int id) {
+            // every worker operates on its own copy of the board
+            Board b = board;
+            PerftTask task;
+            PerftCacheStats local;
+            uint64_t count = 0;
+
+            while (true) {
+                bool found = queues[id].pop(task);
+
+                for (int i = 1; !found && i < threads; i++) {
+                    found = queues[(id + i) % threads].steal(task);
+                }
+
+                // no new tasks are created while running, so empty queues mean we are done
+                if (!found) break;
+
+                for (const auto move : task.line) b.makeMove(move);
+                count += perftSubtree(b, depth - split, local);
+                for (auto it = task.line.rbegin(); it != task.line.rend(); ++it) b.unmakeMove(*it);
+            }
+
+            total += count;
+
+#ifdef CHESS_STATS
+            chess::stats::flush();
+#endif
+
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.hits += local.hits;
+            stats.misses += local.misses;
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 0; i < threads; i++) {
+            pool.emplace_back(worker, i);
+        }
+
+        for (auto &t : pool) {
+            t.join();
+        }
+
+        return total;
+    }
+
+    // Runs perft on the current board, returns the elapsed time in milliseconds.
+    int64_t run(int depth, PerftCacheStats &stats) {
         nodes = 0;
+
+        counters.start();
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        if (threads > 1 || cache.enabled())
+            nodes = perftParallel(depth, stats);
+        else
+            perft(depth, depth);
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        reading = counters.stop();
+
+        return std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+    }
+
+    // Categorises the moves of every ply, stats[ply] receives the moves played at that ply.
+    // Only moves which give check are made, to find out whether they mate.
+    void perftStats(Board &b, int depth, int ply, std::vector<PerftStats> &stats) {
+        Movelist moves;
+        movegen::legalmoves(moves, b);
+
+        auto &s = stats[ply];
+        s.nodes += moves.size();
+
+        const Color c = b.sideToMove();
+
+        for (const auto move : moves) {
+            const auto type = move.typeOf();
+
+            if (type == Move::ENPASSANT) {
+                s.captures++;
+                s.enpassants++;
+            } else if (type != Move::CASTLING && b.at(move.to()) != Piece::NONE) {
+                s.captures++;
+            }
+
+            if (type == Move::CASTLING) s.castles++;
+            if (type == Move::PROMOTION) s.promotions++;
+
+            const Bitboard checkers = c == Color::WHITE ? checkersAfter<Color::WHITE>(b, move)
+                                                        : checkersAfter<Color::BLACK>(b, move);
+
+            if (checkers) {
+                s.checks++;
+
+                // a check only counts as discovered if the moved piece is not one of the checkers
+                if (!(checkers & (1ull << destination(c, move)))) s.discoveredChecks++;
+                if (builtin::popcount(checkers) > 1) s.doubleChecks++;
+
+                b.makeMove(move);
+                assert(b.inCheck());
+                if (movegen::countLegalMoves(b) == 0) s.checkmates++;
+                b.unmakeMove(move);
+            }
+        }
+
+        if (depth == 1) return;
+
+        for (const auto move : moves) {
+            b.makeMove(move);
+            perftStats(b, depth - 1, ply + 1, stats);
+            b.unmakeMove(move);
+        }
+    }
+
+    void printStats(Board &b, int depth) {
+        std::vector<PerftStats> stats(depth);
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        perftStats(b, depth, 0, stats);
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+        std::cout << std::left << std::setw(6) << "depth" << std::setw(13) << "nodes"
+                  << std::setw(12) << "captures" << std::setw(10) << "e.p." << std::setw(10)
+                  << "castles" << std::setw(12) << "promotions" << std::setw(11) << "checks"
+                  << std::setw(11) << "disc.chk" << std::setw(11) << "dbl.chk" << std::setw(11)
+                  << "mates" << std::endl;
+
+        for (int d = 0; d < depth; d++) {
+            const auto &s = stats[d];
+            std::cout << std::setw(6) << d + 1 << std::setw(13) << s.nodes << std::setw(12)
+                      << s.captures << std::setw(10) << s.enpassants << std::setw(10) << s.castles
+                      << std::setw(12) << s.promotions << std::setw(11) << s.checks
+                      << std::setw(11) << s.discoveredChecks << std::setw(11) << s.doubleChecks
+                      << std::setw(11) << s.checkmates << std::endl;
+        }
+
+        std::cout << "\ntime " << ms << std::endl;
+    }
+
+    // Hits and misses of a run, empty if the cache is disabled.
+    std::string describeCache(const PerftCacheStats &stats) const {
+        if (!cache.enabled()) return "";
+
+        const auto probes = stats.hits + stats.misses;
+
         std::stringstream ss;
+        ss << "cache hits " << stats.hits << " misses " << stats.misses << " hitrate "
+           << std::fixed << std::setprecision(2) << (probes ? 100.0 * stats.hits / probes : 0.0)
+           << "%";
 
+        return ss.str();
+    }
+
+    // Prints the node count of every root move, like the divide command of most engines.
+    uint64_t divide(Board &b, int depth) {
         board = b;
 
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+
+        uint64_t total = 0;
+        PerftCacheStats stats;
+
         const auto t1 = std::chrono::high_resolution_clock::now();
-        perft(depth, depth);
+        for (const auto move : moves) {
+            board.makeMove(move);
+            const auto count = depth > 1 ? perftParallel(depth - 1, stats) : 1;
+            board.unmakeMove(move);
+
+            std::cout << uci::moveToUci(move, board.chess960()) << ": " << count << std::endl;
+            total += count;
+        }
         const auto t2 = std::chrono::high_resolution_clock::now();
         const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
 
+        std::cout << "\nmoves " << moves.size() << " nodes " << total << " time " << ms << " nps "
+                  << (total * 1000) / (ms + 1);
+
+        const auto hits = describeCache(stats);
+        if (!hits.empty()) std::cout << " " << hits;
+
+        std::cout << std::endl;
+
+        return total;
+    }
+
+    uint64_t testPositionPerft(Board &b, int depth, uint64_t expectedNodeCount) {
+        std::stringstream ss;
+
+        board = b;
+
+        PerftCacheStats stats;
+        const auto ms = run(depth, stats);
+
         ss << "depth " << std::left << std::setw(2) << depth << " time " << std::setw(5) << ms
            << " nodes " << std::setw(12) << nodes << " nps " << std::setw(9)
            << (nodes * 1000) / (ms + 1) << " fen " << std::setw(87) << board.getFen();
@@ -54,15 +493,305 @@ class PerftTest {
             ss << "Wrong node count ";
         }
 
+        const auto hw = PerfCounters::describe(reading, nodes);
+        if (!hw.empty()) {
+            ss << "\n  " << hw;
+        }
+
+        const auto hits = describeCache(stats);
+        if (!hits.empty()) {
+            ss << "\n  " << hits;
+        }
+
         std::cout << ss.str() << std::endl;
 
         return nodes;
     }
 };
 
-int main() {
+// Chess960 castling rights name the rook file instead of using KQkq.
+bool isChess960Fen(const std::string &fen) {
+    const auto fields = utils::splitString(fen, ' ');
+    if (fields.size() < 3) return false;
+
+    return fields[2].find_first_not_of("KQkq-") != std::string::npos;
+}
+
+// Runs every position of a perftsuite file, lines look like "<fen> ;D1 20 ;D2 400 ;D3 8902".
+// For every depth one line of space separated key value pairs is printed.
+bool runEpdSuite(PerftTest &perft, const std::string &path, int maxDepth) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "cannot open " << path << std::endl;
+        return false;
+    }
+
+    bool passed = true;
+    int index = 0;
+    uint64_t totalNodes = 0;
+    int64_t totalMs = 0;
+    PerftCacheStats totalStats;
+    std::string line;
+
+    while (std::getline(file, line)) {
+        utils::trim(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        auto fields = utils::splitString(line, ';');
+        auto fen = fields[0];
+        utils::trim(fen);
+
+        Board board;
+        board.set960(isChess960Fen(fen));
+        board.setFen(fen);
+
+        for (std::size_t i = 1; i < fields.size(); i++) {
+            std::istringstream entry(fields[i]);
+            std::string tag;
+            uint64_t expected = 0;
+
+            if (!(entry >> tag >> expected) || tag.size() < 2 || tag[0] != 'D') continue;
+
+            const int depth = std::atoi(tag.c_str() + 1);
+            if (depth < 1 || (maxDepth > 0 && depth > maxDepth)) continue;
+
+            perft.board = board;
+
+            PerftCacheStats stats;
+            const auto ms = perft.run(depth, stats);
+            const bool ok = perft.nodes == expected;
+
+            std::cout << "position " << index << " depth " << depth << " nodes " << perft.nodes
+                      << " expected " << expected << " time " << ms << " nps "
+                      << (perft.nodes * 1000) / (ms + 1) << " result " << (ok ? "ok" : "fail");
+
+            const auto hw = PerfCounters::describe(perft.reading, perft.nodes);
+            if (!hw.empty()) std::cout << " " << hw;
+
+            const auto hits = perft.describeCache(stats);
+            if (!hits.empty()) std::cout << " " << hits;
+
+            std::cout << " fen " << fen << std::endl;
+
+            passed &= ok;
+            totalNodes += perft.nodes;
+            totalMs += ms;
+            totalStats.hits += stats.hits;
+            totalStats.misses += stats.misses;
+        }
+
+        index++;
+    }
+
+    std::cout << "\npositions " << index << " nodes " << totalNodes << " time " << totalMs
+              << " nps " << (totalNodes * 1000) / (totalMs + 1) << " result "
+              << (passed ? "ok" : "fail");
+
+    const auto hits = perft.describeCache(totalStats);
+    if (!hits.empty()) std::cout << " " << hits;
+
+    std::cout << std::endl;
+
+    return passed;
+}
+
+// Key of a deep perft work unit, the move counters do not influence the node count.
+std::string unitKey(const std::string &fen) {
+    const auto fields = utils::splitString(fen, ' ');
+    return fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3];
+}
+
+// Collects the positions `ply` plies below the root, transpositions are merged into one unit.
+void collectUnits(Board &b, int ply, std::map<std::string, uint64_t> &units) {
+    if (ply == 0) {
+        units[unitKey(b.getFen())]++;
+        return;
+    }
+
+    Movelist moves;
+    movegen::legalmoves(moves, b);
+
+    for (const auto move : moves) {
+        b.makeMove(move);
+        collectUnits(b, ply - 1, units);
+        b.unmakeMove(move);
+    }
+}
+
+// FNV-1a of a journal entry, lines which were cut off or damaged fail the comparison.
+std::string journalChecksum(const std::string &entry) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (const char c : entry) {
+        hash ^= uint8_t(c);
+        hash *= 0x100000001b3ull;
+    }
+
+    std::stringstream ss;
+    ss << std::hex << hash;
+    return ss.str();
+}
+
+// Reads the finished units of a journal, returns false if the journal belongs to another run.
+// Lines look like "<unit>;<nodes>;<checksum>", every line which does not parse is not done.
+bool readJournal(const std::string &path, const std::string &header,
+                 std::map<std::string, uint64_t> &done) {
+    std::ifstream file(path);
+    std::string line;
+
+    if (!std::getline(file, line)) return true;
+    if (line != header) return false;
+
+    while (std::getline(file, line)) {
+        const auto fields = utils::splitString(line, ';');
+        // a line cut off by a crash or otherwise damaged is skipped, the unit is simply redone
+        if (fields.size() != 3 || fields[1].empty() || fields[1].size() > 19) continue;
+        if (fields[1].find_first_not_of("0123456789") != std::string::npos) continue;
+        if (journalChecksum(fields[0] + ";" + fields[1]) != fields[2]) continue;
+
+        done[fields[0]] = std::stoull(fields[1]);
+    }
+
+    return true;
+}
+
+// Appends one line with a single write, so lines of several processes do not interleave.
+void appendJournal(const std::string &path, const std::string &line) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return;
+
+    const auto data = line + "\n";
+    if (write(fd, data.data(), data.size()) == ssize_t(data.size())) fsync(fd);
+    close(fd);
+}
+
+// Deep perft, split into independent work units at `split` plies below the root.
+// Finished units are written to the journal, so a killed run continues where it stopped.
+// With more than one process the units are distributed over forked workers.
+bool runDeepPerft(PerftTest &perft, const std::string &fen, int depth, int split,
+                  const std::string &journal, int processes, uint64_t &nodes,
+                  bool printUnits = true) {
+    split = std::max(0, std::min(split, depth));
+
+    Board root;
+    root.set960(isChess960Fen(fen));
+    root.setFen(fen);
+
+    std::map<std::string, uint64_t> units;
+    collectUnits(root, split, units);
+
+    std::stringstream header;
+    header << "# deep perft fen " << unitKey(root.getFen()) << " depth " << depth << " split "
+           << split;
+
+    std::map<std::string, uint64_t> done;
+    if (!readJournal(journal, header.str(), done)) {
+        std::cerr << journal << " belongs to a different run" << std::endl;
+        return false;
+    }
+
+    if (done.empty()) {
+        std::ifstream existing(journal);
+        if (!existing.good() || existing.peek() == std::ifstream::traits_type::eof())
+            appendJournal(journal, header.str());
+    }
+
+    // a crash in the middle of a write leaves a line without newline, which the next entry
+    // must not continue
+    std::ifstream tail(journal, std::ios::binary);
+    if (tail.seekg(-1, std::ios::end) && tail.get() != '\n') appendJournal(journal, "");
+
+    std::vector<std::string> pending;
+    for (const auto &unit : units) {
+        if (!done.count(unit.first)) pending.push_back(unit.first);
+    }
+
+    std::cout << "units " << units.size() << " finished " << units.size() - pending.size()
+              << " pending " << pending.size() << std::endl;
+
+    const int remaining = depth - split;
+
+    const auto work = [&](int id, int count) {
+        for (std::size_t i = id; i < pending.size(); i += count) {
+            Board board;
+            board.set960(root.chess960());
+            board.setFen(pending[i]);
+
+            perft.board = board;
+
+            PerftCacheStats stats;
+            const auto ms = remaining > 0 ? perft.run(remaining, stats) : 0;
+            const uint64_t unitNodes = remaining > 0 ? perft.nodes : 1;
+
+            const auto entry = pending[i] + ";" + std::to_string(unitNodes);
+            appendJournal(journal, entry + ";" + journalChecksum(entry));
+
+            if (!printUnits) continue;
+
+            std::cout << "unit " << pending[i] << " nodes " << unitNodes << " time " << ms;
+
+            const auto hits = perft.describeCache(stats);
+            if (!hits.empty()) std::cout << " " << hits;
+
+            std::cout << std::endl;
+        }
+    };
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    if (processes > 1) {
+        std::vector<pid_t> children;
+
+        for (int id = 0; id < processes; id++) {
+            const pid_t pid = fork();
+
+            if (pid == 0) {
+                work(id, processes);
+                std::exit(0);
+            }
+
+            if (pid > 0) children.push_back(pid);
+        }
+
+        for (const auto pid : children) waitpid(pid, nullptr, 0);
+    } else {
+        work(0, 1);
+    }
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+    done.clear();
+    readJournal(journal, header.str(), done);
+
+    nodes = 0;
+    std::size_t missing = 0;
+
+    for (const auto &unit : units) {
+        const auto it = done.find(unit.first);
+        if (it == done.end()) {
+            missing++;
+            continue;
+        }
+        nodes += unit.second * it->second;
+    }
+
+    if (missing) {
+        std::cout << "\nincomplete, " << missing << " units missing" << std::endl;
+        return false;
+    }
+
+    std::cout << "\ndepth " << depth << " nodes " << nodes << " time " << ms << " fen "
+              << root.getFen() << std::endl;
+
+    return true;
+}
+
+void runBuiltinSuite(PerftTest &perft) {
     Board board = Board("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
-    PerftTest perft = PerftTest();
+
+    std::cout << "slider attacks " << (movegen::USE_PEXT ? "pext" : "magic") << ", slider sets "
+              << movegen::attacks::SLIDERS_ALL_BACKEND << "\n\n";
 
     U64 totalNodes = 0;
 
@@ -121,5 +850,145 @@ int main() {
     std::cout << "\naveraged: \n"
               << "nodes " << totalNodes << " nps " << (totalNodes * 1000) / (ms + 1) << std::endl;
 
-    return 0;
-}
\ No newline at end of file
+    std::cout << "\nChess960 deep perft\n";
+
+    // the units are rebuilt from their FEN, which has to keep the castling rights intact
+    const std::string deepFen = "4rrb1/1kp3b1/1p1p4/pP1Pn2p/5p2/1PR2P2/2P1NB1P/2KR1B2 w D - 0 21";
+    // a journal of our own in the temp directory, the user's journals stay untouched
+    const std::string deepJournal =
+        (std::filesystem::temp_directory_path() /
+         ("chess-perft-960-" + std::to_string(getpid()) + ".journal"))
+            .string();
+
+    board.setFen(deepFen);
+    perft.board = board;
+
+    PerftCacheStats deepStats;
+    perft.run(4, deepStats);
+    const uint64_t expected = perft.nodes;
+
+    uint64_t deepNodes = 0;
+    std::remove(deepJournal.c_str());
+    runDeepPerft(perft, deepFen, 4, 2, deepJournal, 1, deepNodes, false);
+    std::remove(deepJournal.c_str());
+
+    if (deepNodes != expected) {
+        std::cout << "Wrong node count, deep perft " << deepNodes << " perft " << expected
+                  << std::endl;
+    }
+
+    std::cout << "\nSAN round trips\n";
+
+    // three knights reach e7, c8e7 shares its file with c6 and needs the rank
+    board.set960(false);
+    board.setFen("2NB2k1/Q7/2NR4/1P1N1p2/2B1n2p/p7/P1P3PK/7R w - - 1 39");
+
+    Movelist sanMoves;
+    movegen::legalmoves(sanMoves, board);
+
+    for (const auto move : sanMoves) {
+        const auto san = uci::moveToSan(board, move);
+        if (uci::parseSan(board, san) != move) {
+            std::cout << "Wrong san " << san << " for " << uci::moveToUci(move) << std::endl;
+        }
+    }
+
+    if (uci::moveToSan(board, uci::uciToMove(board, "c8e7")) != "N8e7+") {
+        std::cout << "Wrong san for c8e7" << std::endl;
+    }
+
+    std::cout << "moves " << sanMoves.size() << std::endl;
+
+    std::cout << "\nComparing leaf counting\n";
+
+    board.set960(false);
+    board.setFen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+
+    std::chrono::milliseconds::rep leafMs[2];
+
+    for (const bool bulk : {false, true}) {
+        perft.bulk = bulk;
+
+        t1 = std::chrono::high_resolution_clock::now();
+        perft.testPositionPerft(board, 5, 193690690);
+        t2 = std::chrono::high_resolution_clock::now();
+
+        leafMs[bulk] = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+    }
+
+    std::cout << "\nmovelist " << leafMs[0] << " ms countLegalMoves " << leafMs[1]
+              << " ms speedup " << std::fixed << std::setprecision(2)
+              << double(leafMs[0] + 1) / double(leafMs[1] + 1) << "x" << std::endl;
+}
+
+int main(int argc, char const *argv[]) {
+    PerftTest perft;
+
+    if (!perft.counters.available()) {
+        std::cerr << "hardware counters unavailable, reporting timings only" << std::endl;
+    }
+
+    std::string epd;
+    std::string fen = STARTPOS;
+    int depth = 0;
+    int divideDepth = 0;
+    int statsDepth = 0;
+    int deepDepth = 0;
+    int split = 2;
+    int processes = 1;
+    std::string journal = "perft.journal";
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            perft.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            perft.cache.resize(std::max(0, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--epd") == 0 && i + 1 < argc) {
+            epd = argv[++i];
+        } else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fen") == 0 && i + 1 < argc) {
+            fen = argv[++i];
+        } else if (std::strcmp(argv[i], "divide") == 0 && i + 1 < argc) {
+            divideDepth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "stats") == 0 && i + 1 < argc) {
+            statsDepth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "deep") == 0 && i + 1 < argc) {
+            deepDepth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--split") == 0 && i + 1 < argc) {
+            split = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+            journal = argv[++i];
+        } else if (std::strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            processes = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+
+    int result = 0;
+
+    if (divideDepth > 0) {
+        Board board;
+        board.set960(isChess960Fen(fen));
+        board.setFen(fen);
+        perft.divide(board, divideDepth);
+    } else if (statsDepth > 0) {
+        Board board;
+        board.set960(isChess960Fen(fen));
+        board.setFen(fen);
+        perft.printStats(board, statsDepth);
+    } else if (deepDepth > 0) {
+        uint64_t nodes = 0;
+        result = runDeepPerft(perft, fen, deepDepth, split, journal, processes, nodes) ? 0 : 1;
+    } else if (!epd.empty()) {
+        result = runEpdSuite(perft, epd, depth) ? 0 : 1;
+    } else {
+        runBuiltinSuite(perft);
+    }
+
+#ifdef CHESS_STATS
+    std::cout << "\nHot path statistics\n";
+    chess::stats::print(std::cout, chess::stats::total());
+#endif
+
+    return result;
+}
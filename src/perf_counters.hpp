@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware performance counters through perf_event_open.
+// When the counters cannot be opened (no Linux, missing permissions, virtual machines)
+// available() is false and every reading is zero, callers then only report timings.
+class PerfCounters {
+   public:
+    enum Event { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, DTLB_MISSES, COUNT };
+
+    struct Reading {
+        uint64_t values[COUNT] = {};
+        bool valid[COUNT] = {};
+
+        double ipc() const {
+            return valid[CYCLES] && valid[INSTRUCTIONS] && values[CYCLES]
+                       ? double(values[INSTRUCTIONS]) / double(values[CYCLES])
+                       : 0.0;
+        }
+    };
+
+    PerfCounters() {
+#if defined(__linux__)
+        const std::pair<uint32_t, uint64_t> events[COUNT] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D)},
+            {PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_LL)},
+            {PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB)},
+        };
+
+        for (int i = 0; i < COUNT; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // count the threads spawned by the parallel perft as well
+            attr.inherit = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds_[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (const int fd : fds_) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const {
+        for (const int fd : fds_) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+
+    void start() {
+#if defined(__linux__)
+        for (const int fd : fds_) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    Reading stop() {
+        Reading reading;
+#if defined(__linux__)
+        for (int i = 0; i < COUNT; i++) {
+            if (fds_[i] < 0) continue;
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            // value, time enabled, time running
+            uint64_t data[3] = {};
+            if (read(fds_[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+
+            // scale up in case the kernel had to multiplex the counters
+            reading.values[i] = uint64_t(double(data[0]) * double(data[1]) / double(data[2]));
+            reading.valid[i] = true;
+        }
+#endif
+        return reading;
+    }
+
+    // Formats the counters as "ipc 2.31 cycles/node 12.5 ...", empty if nothing was counted.
+    static std::string describe(const Reading &reading, uint64_t nodes,
+                                const std::string &unit = "node") {
+        static const char *NAMES[COUNT] = {"cycles",       "instructions", "branch-misses",
+                                           "l1d-misses",   "llc-misses",   "dtlb-misses"};
+
+        std::stringstream ss;
+        ss.setf(std::ios::fixed);
+        ss.precision(3);
+
+        if (reading.valid[CYCLES] && reading.valid[INSTRUCTIONS]) ss << "ipc " << reading.ipc();
+
+        for (int i = 0; i < COUNT; i++) {
+            if (!reading.valid[i] || i == INSTRUCTIONS) continue;
+            if (ss.tellp() > 0) ss << " ";
+            ss << NAMES[i] << "/" << unit << " "
+               << double(reading.values[i]) / double(nodes ? nodes : 1);
+        }
+
+        return ss.str();
+    }
+
+   private:
+#if defined(__linux__)
+    static constexpr uint64_t cacheEvent(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+#endif
+
+    int fds_[COUNT] = {-1, -1, -1, -1, -1, -1};
+};